@@ -7,6 +7,7 @@
 
 #include "effect_module.hpp"
 #include <memory> // std::unique_ptr
+#include <functional> // std::function
 #include <algorithm> // std::find_if
 
 namespace reshadefx
@@ -17,6 +18,11 @@ namespace reshadefx
 	class codegen
 	{
 	public:
+		/// <summary>
+		/// Function that calls the specified function once for every index in the range [0, count), possibly concurrently, and only returns after all calls have finished.
+		/// </summary>
+		using parallel_for_function = std::function<void(size_t count, const std::function<void(size_t)> &func)>;
+
 		/// <summary>
 		/// Virtual destructor to guarantee that memory of the implementations deriving from this interface is properly destroyed.
 		/// </summary>
@@ -26,7 +32,28 @@ namespace reshadefx
 		/// Writes result of the code generation to the specified <paramref name="module"/>.
 		/// </summary>
 		/// <param name="module">Target module to fill.</param>
-		virtual void write_result(module &module) = 0;
+		/// <param name="split_entry_points">Set to <see langword="true"/> to additionally write code for every entry point that only contains the functions it references (see <see cref="entry_point::hlsl"/> and <see cref="entry_point::spirv"/>).</param>
+		/// <param name="executor">Optional function used to write the code of the module and its entry points in parallel (see <see cref="parallel_for_function"/>), or <see langword="nullptr"/> to write it on the calling thread. The result does not depend on this.</param>
+		virtual void write_result(module &module, bool split_entry_points = false, const parallel_for_function &executor = nullptr) = 0;
+
+		/// <summary>
+		/// Sets the table used to look up the source file names of locations passed to this code generator (for debugging).
+		/// </summary>
+		/// <param name="sources">Table of source file names, which has to stay alive while code is generated.</param>
+		void set_source_table(const source_table *sources) { _sources = sources; }
+
+		/// <summary>
+		/// Gets the number of redundant texture fetches that were eliminated during code generation (only when optimizations are enabled).
+		/// </summary>
+		unsigned int eliminated_texture_fetches() const { return _eliminated_texture_fetches; }
+		/// <summary>
+		/// Gets the number of redundant uniform variable loads that were eliminated during code generation (only when optimizations are enabled).
+		/// </summary>
+		unsigned int eliminated_uniform_loads() const { return _eliminated_uniform_loads; }
+		/// <summary>
+		/// Gets the number of all other redundant operations that were eliminated during code generation (only when optimizations are enabled).
+		/// </summary>
+		unsigned int eliminated_operations() const { return _eliminated_operations; }
 
 	public:
 		/// <summary>
@@ -221,6 +248,22 @@ namespace reshadefx
 		/// Returns <see langword="true"/> if code is currently added to a function.
 		/// </summary>
 		virtual bool is_in_function() const { return is_in_block(); }
+		/// <summary>
+		/// Returns <see langword="true"/> if optimizations are enabled, in which case the parser may also simplify control flow it knows the outcome of at compile time (like only generating code for the branch that is taken when the condition is constant).
+		/// </summary>
+		virtual bool is_optimizing() const { return false; }
+
+		/// <summary>
+		/// Marks whether the code that is added from now on is unreachable, in which case it is only generated to check it for errors and then thrown away (like a branch the parser knows at compile time is never taken).
+		/// Back-ends should not add any global state referencing such code then (like decorations of its instructions).
+		/// </summary>
+		/// <param name="unreachable">Set to <see langword="true"/> to mark the code as unreachable.</param>
+		/// <returns>The previous value.</returns>
+		bool set_unreachable(bool unreachable) { const bool previous = _unreachable; _unreachable = unreachable; return previous; }
+		/// <summary>
+		/// Returns <see langword="true"/> if the code that is currently added is unreachable (see <see cref="set_unreachable"/>).
+		/// </summary>
+		bool is_unreachable() const { return _unreachable; }
 
 		/// <summary>
 		/// Creates a new basic block.
@@ -329,14 +372,36 @@ namespace reshadefx
 			return align_up(size, alignment) * (elements - 1) + size;
 		}
 
+		/// <summary>
+		/// Calls the specified function once for every index in the range [0, <paramref name="count"/>), using the <paramref name="executor"/> passed to <see cref="write_result"/> if there is one.
+		/// </summary>
+		static void parallel_for(size_t count, const parallel_for_function &executor, const std::function<void(size_t)> &func)
+		{
+			if (executor != nullptr)
+				return executor(count, func);
+
+			for (size_t i = 0; i < count; ++i)
+				func(i);
+		}
+
 		reshadefx::module _module;
+		const source_table *_sources = nullptr;
 		std::vector<struct_info> _structs;
 		std::vector<std::unique_ptr<function_info>> _functions;
 		id _next_id = 1;
 		id _last_block = 0;
 		id _current_block = 0;
+		bool _unreachable = false;
+		unsigned int _eliminated_texture_fetches = 0;
+		unsigned int _eliminated_uniform_loads = 0;
+		unsigned int _eliminated_operations = 0;
 	};
 
+	/// <summary>
+	/// Version of the code generation, which has to be incremented whenever the parser or any back-end generates different code for the same input, so that modules cached by an older version are no longer used.
+	/// </summary>
+	constexpr unsigned int codegen_version = 1;
+
 	/// <summary>
 	/// Creates a back-end implementation for GLSL code generation.
 	/// </summary>
@@ -345,14 +410,16 @@ namespace reshadefx
 	/// <param name="uniforms_to_spec_constants">Whether to convert uniform variables to specialization constants.</param>
 	/// <param name="enable_16bit_types">Use real 16-bit types for the minimum precision types "min16int", "min16uint" and "min16float".</param>
 	/// <param name="flip_vert_y">Insert code to flip the Y component of the output position in vertex shaders.</param>
-	codegen *create_codegen_glsl(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types = false, bool flip_vert_y = false);
+	/// <param name="optimize">Whether to perform constant propagation, identity elimination and strength reduction on the code before generating it.</param>
+	codegen *create_codegen_glsl(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types = false, bool flip_vert_y = false, bool optimize = false);
 	/// <summary>
 	/// Creates a back-end implementation for HLSL code generation.
 	/// </summary>
 	/// <param name="shader_model">The HLSL shader model version (e.g. 30, 41, 50, 60, ...)</param>
 	/// <param name="debug_info">Whether to append debug information like line directives to the generated code.</param>
 	/// <param name="uniforms_to_spec_constants">Whether to convert uniform variables to specialization constants.</param>
-	codegen *create_codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants);
+	/// <param name="optimize">Whether to perform constant propagation, identity elimination and strength reduction on the code before generating it.</param>
+	codegen *create_codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants, bool optimize = false);
 	/// <summary>
 	/// Creates a back-end implementation for SPIR-V code generation.
 	/// </summary>
@@ -361,5 +428,6 @@ namespace reshadefx
 	/// <param name="uniforms_to_spec_constants">Whether to convert uniform variables to specialization constants.</param>
 	/// <param name="enable_16bit_types">Use real 16-bit types for the minimum precision types "min16int", "min16uint" and "min16float".</param>
 	/// <param name="flip_vert_y">Insert code to flip the Y component of the output position in vertex shaders.</param>
-	codegen *create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types = false, bool flip_vert_y = false);
+	/// <param name="optimize">Whether to perform constant propagation, identity elimination and strength reduction on the code before generating it.</param>
+	codegen *create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types = false, bool flip_vert_y = false, bool optimize = false);
 }
@@ -5,6 +5,7 @@
 
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
+#include "effect_codegen_optimizer.hpp"
 #include <cmath> // signbit, isinf, isnan
 #include <cstdio> // snprintf
 #include <cassert>
@@ -13,7 +14,7 @@
 
 using namespace reshadefx;
 
-class codegen_glsl final : public codegen
+class codegen_glsl : public codegen
 {
 public:
 	codegen_glsl(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y)
@@ -24,7 +25,7 @@ public:
 		block.reserve(8192);
 	}
 
-private:
+protected:
 	enum class naming
 	{
 		// After escaping, name should already be unique, so no additional steps are taken
@@ -40,6 +41,8 @@ private:
 	std::string _ubo_block;
 	std::string _compute_block;
 	std::unordered_map<id, std::string> _names;
+	// Number of IDs that use each name, so that clashes can be detected without searching through all names
+	std::unordered_map<std::string, unsigned int> _name_usage;
 	std::unordered_map<id, std::string> _blocks;
 	bool _debug_info = false;
 	bool _vulkan_semantics = false;
@@ -50,24 +53,39 @@ private:
 	std::unordered_map<id, id> _remapped_sampler_variables;
 	std::unordered_map<std::string, uint32_t> _semantic_to_location;
 
+	struct entry_point_code
+	{
+		// Functions this entry point consists of (the function it refers to and the "main" function generated for it)
+		std::vector<id> functions;
+		// Range in the global block with code that only belongs to this entry point
+		std::pair<size_t, size_t> range;
+	};
+
+	// Ranges in the global block with the code of every function (in the same order as '_functions')
+	std::vector<std::pair<size_t, size_t>> _function_ranges;
+	// Code belonging to every entry point (in the same order as the entry points in the module)
+	std::vector<entry_point_code> _entry_points_code;
+
 	// Only write compatibility intrinsics to result if they are actually in use
 	bool _uses_fmod = false;
 	bool _uses_componentwise_or = false;
 	bool _uses_componentwise_and = false;
 	bool _uses_componentwise_cond = false;
 
-	void write_result(module &module) override
+	void write_result(module &module, bool split_entry_points, const parallel_for_function &executor) override
 	{
 		module = std::move(_module);
 
+		std::string preamble;
+
 		if (_enable_16bit_types)
 			// GL_NV_gpu_shader5, GL_AMD_gpu_shader_half_float or GL_EXT_shader_16bit_storage
-			module.hlsl += "#extension GL_NV_gpu_shader5 : require\n";
+			preamble += "#extension GL_NV_gpu_shader5 : require\n";
 		if (_enable_control_flow_attributes)
-			module.hlsl += "#extension GL_EXT_control_flow_attributes : enable\n";
+			preamble += "#extension GL_EXT_control_flow_attributes : enable\n";
 
 		if (_uses_fmod)
-			module.hlsl += "float fmodHLSL(float x, float y) { return x - y * trunc(x / y); }\n"
+			preamble += "float fmodHLSL(float x, float y) { return x - y * trunc(x / y); }\n"
 				"vec2 fmodHLSL(vec2 x, vec2 y) { return x - y * trunc(x / y); }\n"
 				"vec3 fmodHLSL(vec3 x, vec3 y) { return x - y * trunc(x / y); }\n"
 				"vec4 fmodHLSL(vec4 x, vec4 y) { return x - y * trunc(x / y); }\n"
@@ -75,17 +93,17 @@ private:
 				"mat3 fmodHLSL(mat3 x, mat3 y) { return x - matrixCompMult(y, mat3(trunc(x[0] / y[0]), trunc(x[1] / y[1]), trunc(x[2] / y[2]))); }\n"
 				"mat4 fmodHLSL(mat4 x, mat4 y) { return x - matrixCompMult(y, mat4(trunc(x[0] / y[0]), trunc(x[1] / y[1]), trunc(x[2] / y[2]), trunc(x[3] / y[3]))); }\n";
 		if (_uses_componentwise_or)
-			module.hlsl +=
+			preamble +=
 				"bvec2 compOr(bvec2 a, bvec2 b) { return bvec2(a.x || b.x, a.y || b.y); }\n"
 				"bvec3 compOr(bvec3 a, bvec3 b) { return bvec3(a.x || b.x, a.y || b.y, a.z || b.z); }\n"
 				"bvec4 compOr(bvec4 a, bvec4 b) { return bvec4(a.x || b.x, a.y || b.y, a.z || b.z, a.w || b.w); }\n";
 		if (_uses_componentwise_and)
-			module.hlsl +=
+			preamble +=
 				"bvec2 compAnd(bvec2 a, bvec2 b) { return bvec2(a.x && b.x, a.y && b.y); }\n"
 				"bvec3 compAnd(bvec3 a, bvec3 b) { return bvec3(a.x && b.x, a.y && b.y, a.z && b.z); }\n"
 				"bvec4 compAnd(bvec4 a, bvec4 b) { return bvec4(a.x && b.x, a.y && b.y, a.z && b.z, a.w && b.w); }\n";
 		if (_uses_componentwise_cond)
-			module.hlsl +=
+			preamble +=
 				"vec2 compCond(bvec2 cond, vec2 a, vec2 b) { return vec2(cond.x ? a.x : b.x, cond.y ? a.y : b.y); }\n"
 				"vec3 compCond(bvec3 cond, vec3 a, vec3 b) { return vec3(cond.x ? a.x : b.x, cond.y ? a.y : b.y, cond.z ? a.z : b.z); }\n"
 				"vec4 compCond(bvec4 cond, vec4 a, vec4 b) { return vec4(cond.x ? a.x : b.x, cond.y ? a.y : b.y, cond.z ? a.z : b.z, cond.w ? a.w : b.w); }\n"
@@ -99,9 +117,58 @@ private:
 		if (!_ubo_block.empty())
 			// Read matrices in column major layout, even though they are actually row major, to avoid transposing them on every access (since GLSL uses column matrices)
 			// TODO: This technically only works with square matrices
-			module.hlsl += "layout(std140, column_major, binding = 0) uniform _Globals {\n" + _ubo_block + "};\n";
+			preamble += "layout(std140, column_major, binding = 0) uniform _Globals {\n" + _ubo_block + "};\n";
 
-		module.hlsl += _blocks.at(0);
+		const std::string &code = _blocks.at(0);
+
+		module.hlsl.reserve(preamble.size() + code.size());
+		module.hlsl += preamble;
+		module.hlsl += code;
+
+		if (split_entry_points)
+		{
+			// Every entry point writes to its own string and only reads the generated code, so they can be written concurrently
+			parallel_for(module.entry_points.size(), executor, [this, &module, &preamble](size_t i) {
+				module.entry_points[i].hlsl = preamble;
+				write_entry_point_code(module.entry_points[i].hlsl, i);
+			});
+		}
+	}
+	void write_entry_point_code(std::string &s, size_t entry_point_index)
+	{
+		const entry_point_code &entry_point = _entry_points_code[entry_point_index];
+
+		std::unordered_set<id> referenced_functions;
+		for (const id function : entry_point.functions)
+		{
+			referenced_functions.insert(function);
+
+			const function_info &info = find_function(function);
+			referenced_functions.insert(info.referenced_functions.begin(), info.referenced_functions.end());
+		}
+
+		// Skip the code of all functions that are not referenced by this entry point, as well as the code of all other entry points
+		std::vector<std::pair<size_t, size_t>> skip_ranges;
+		for (size_t i = 0; i < _functions.size(); ++i)
+			if (referenced_functions.find(_functions[i]->definition) == referenced_functions.end())
+				skip_ranges.push_back(_function_ranges[i]);
+		for (size_t i = 0; i < _entry_points_code.size(); ++i)
+			if (i != entry_point_index)
+				skip_ranges.push_back(_entry_points_code[i].range);
+
+		std::sort(skip_ranges.begin(), skip_ranges.end());
+
+		const std::string &code = _blocks.at(0);
+
+		size_t offset = 0;
+		for (const std::pair<size_t, size_t> &range : skip_ranges)
+		{
+			if (range.first > offset)
+				s.append(code, offset, range.first - offset);
+			offset = std::max(offset, range.second);
+		}
+
+		s.append(code, offset);
 	}
 
 	template <bool is_param = false, bool is_decl = true, bool is_interface = false>
@@ -277,7 +344,7 @@ private:
 					break;
 				}
 				if (std::isinf(data.as_float[i])) {
-					s += std::signbit(data.as_float[i]) ? "1.0/0.0/*inf*/" : "-1.0/0.0/*-inf*/";
+					s += std::signbit(data.as_float[i]) ? "-1.0/0.0/*-inf*/" : "1.0/0.0/*inf*/";
 					break;
 				}
 				char temp[64]; // Will be null-terminated by snprintf
@@ -297,7 +364,7 @@ private:
 	}
 	void write_location(std::string &s, const location &loc) const
 	{
-		if (loc.source.empty() || !_debug_info)
+		if (loc.source == 0 || !_debug_info)
 			return;
 
 		s += "#line " + std::to_string(loc.line) + '\n';
@@ -326,9 +393,20 @@ private:
 		if constexpr (naming_type != naming::reserved)
 			name = escape_name(std::move(name));
 		if constexpr (naming_type == naming::general)
-			if (std::find_if(_names.begin(), _names.end(), [&name](const auto &it) { return it.second == name; }) != _names.end())
+			if (_name_usage.find(name) != _name_usage.end())
 				name += '_' + std::to_string(id); // Append a numbered suffix if the name already exists
-		_names[id] = std::move(name);
+
+		std::string &entry = _names[id];
+		if (!entry.empty())
+			release_name(entry);
+		_name_usage[name]++;
+		entry = std::move(name);
+	}
+	void release_name(const std::string &name)
+	{
+		if (const auto usage_it = _name_usage.find(name);
+			usage_it != _name_usage.end() && --usage_it->second == 0)
+			_name_usage.erase(usage_it);
 	}
 
 	uint32_t semantic_to_location(const std::string &semantic, uint32_t max_array_length = 1)
@@ -427,10 +505,24 @@ private:
 		if (block.empty())
 			return;
 
-		for (size_t pos = 0; (pos = block.find("\n\t", pos)) != std::string::npos; pos += 3)
-			block.replace(pos, 2, "\n\t\t");
+		// Build the indented code in a single pass, instead of inserting into the block for every line (which would move all following code every time)
+		std::string indented_block;
+		indented_block.reserve(block.size() + std::count(block.begin(), block.end(), '\n') + 1);
+		indented_block += '\t';
+
+		for (size_t offset = 0, pos; offset < block.size(); offset = pos + 2)
+		{
+			if ((pos = block.find("\n\t", offset)) == std::string::npos)
+			{
+				indented_block.append(block, offset);
+				break;
+			}
+
+			indented_block.append(block, offset, pos - offset);
+			indented_block += "\n\t\t";
+		}
 
-		block.insert(block.begin(), '\t');
+		block = std::move(indented_block);
 	}
 
 	id   define_struct(const location &loc, struct_info &info) override
@@ -689,6 +781,9 @@ private:
 
 		std::string &code = _blocks.at(_current_block);
 
+		// Function code ends after the function body, which is added in 'leave_function'
+		_function_ranges.push_back({ code.size(), code.size() });
+
 		write_location(code, loc);
 
 		write_type(code, info.return_type);
@@ -740,7 +835,11 @@ private:
 				return;
 		}
 
-		_module.entry_points.push_back({ func.unique_name, stype });
+		_module.entry_points.push_back({ func.unique_name, stype, {}, {} });
+
+		entry_point_code &entry_point_info = _entry_points_code.emplace_back();
+		entry_point_info.functions.push_back(func.definition);
+		entry_point_info.range.first = _blocks.at(0).size();
 
 		_blocks.at(0) += "#ifdef ENTRY_POINT_" + func.unique_name + '\n';
 		if (stype == shader_type::cs)
@@ -1086,6 +1185,9 @@ private:
 		leave_function();
 
 		_blocks.at(0) += "#endif\n";
+
+		entry_point_info.functions.push_back(entry_point.definition);
+		entry_point_info.range.second = _blocks.at(0).size();
 	}
 
 	id   emit_load(const expression &exp, bool force_new_id) override
@@ -1953,11 +2055,19 @@ private:
 	{
 		assert(_last_block != 0);
 
-		_blocks.at(0) += "{\n" + _blocks.at(_last_block) + "}\n";
+		std::string &code = _blocks.at(0);
+
+		code += "{\n";
+		code += _blocks.at(_last_block);
+		code += "}\n";
+
+		_function_ranges.back().second = code.size();
 	}
 };
 
-codegen *reshadefx::create_codegen_glsl(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y)
+codegen *reshadefx::create_codegen_glsl(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y, bool optimize)
 {
+	if (optimize)
+		return new codegen_optimizer<codegen_glsl>(vulkan_semantics, debug_info, uniforms_to_spec_constants, enable_16bit_types, flip_vert_y);
 	return new codegen_glsl(vulkan_semantics, debug_info, uniforms_to_spec_constants, enable_16bit_types, flip_vert_y);
 }
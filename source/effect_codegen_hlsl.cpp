@@ -5,6 +5,7 @@
 
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
+#include "effect_codegen_optimizer.hpp"
 #include <cmath> // signbit, isinf, isnan
 #include <cstdio> // snprintf
 #include <cassert>
@@ -13,7 +14,7 @@
 
 using namespace reshadefx;
 
-class codegen_hlsl final : public codegen
+class codegen_hlsl : public codegen
 {
 public:
 	codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants)
@@ -24,7 +25,7 @@ public:
 		block.reserve(8192);
 	}
 
-private:
+protected:
 	enum class naming
 	{
 		// Name should already be unique, so no additional steps are taken
@@ -36,33 +37,50 @@ private:
 	};
 
 	std::string _cbuffer_block;
-	std::string _current_location;
+	uint32_t _current_location = 0;
 	std::unordered_map<id, std::string> _names;
+	// Number of IDs that use each name, so that clashes can be detected without searching through all names
+	std::unordered_map<std::string, unsigned int> _name_usage;
 	std::unordered_map<id, std::string> _blocks;
 	bool _debug_info = false;
 	bool _uniforms_to_spec_constants = false;
 	unsigned int _shader_model = 0;
 
+	struct entry_point_code
+	{
+		// Functions this entry point consists of (the function it refers to and an optional wrapper function generated for it)
+		std::vector<id> functions;
+		// Range in the global block with code that only belongs to this entry point
+		std::pair<size_t, size_t> range;
+	};
+
+	// Ranges in the global block with the code of every function (in the same order as '_functions')
+	std::vector<std::pair<size_t, size_t>> _function_ranges;
+	// Code belonging to every entry point (in the same order as the entry points in the module)
+	std::vector<entry_point_code> _entry_points_code;
+
 	// Only write compatibility intrinsics to result if they are actually in use
 	bool _uses_bitwise_cast = false;
 
-	void write_result(module &module) override
+	void write_result(module &module, bool split_entry_points, const parallel_for_function &executor) override
 	{
 		module = std::move(_module);
 
+		std::string preamble;
+
 		if (_shader_model >= 40)
 		{
-			module.hlsl += "struct __sampler2D { Texture2D t; SamplerState s; };\n";
+			preamble += "struct __sampler2D { Texture2D t; SamplerState s; };\n";
 
 			if (!_cbuffer_block.empty())
-				module.hlsl += "cbuffer _Globals {\n" + _cbuffer_block + "};\n";
+				preamble += "cbuffer _Globals {\n" + _cbuffer_block + "};\n";
 		}
 		else
 		{
-			module.hlsl += "struct __sampler2D { sampler2D s; float2 pixelsize; };\nuniform float2 __TEXEL_SIZE__ : register(c255);\n";
+			preamble += "struct __sampler2D { sampler2D s; float2 pixelsize; };\nuniform float2 __TEXEL_SIZE__ : register(c255);\n";
 
 			if (_uses_bitwise_cast)
-				module.hlsl +=
+				preamble +=
 					"int __asint(float v) {"
 					"	if (v == 0) return 0;" // Zero (does not handle negative zero)
 					//	if (isinf(v)) return v < 0 ? 4286578688 : 2139095040; // Infinity
@@ -95,13 +113,62 @@ private:
 					"float4 __asfloat(int4 v) { return float4(__asfloat(v.x), __asfloat(v.y), __asfloat(v.z), __asfloat(v.w)); }\n";
 
 			if (!_cbuffer_block.empty())
-				module.hlsl += _cbuffer_block;
+				preamble += _cbuffer_block;
 
 			// Offsets were multiplied in 'define_uniform', so adjust total size here accordingly
 			module.total_uniform_size *= 4;
 		}
 
-		module.hlsl += _blocks.at(0);
+		const std::string &code = _blocks.at(0);
+
+		module.hlsl.reserve(preamble.size() + code.size());
+		module.hlsl += preamble;
+		module.hlsl += code;
+
+		if (split_entry_points)
+		{
+			// Every entry point writes to its own string and only reads the generated code, so they can be written concurrently
+			parallel_for(module.entry_points.size(), executor, [this, &module, &preamble](size_t i) {
+				module.entry_points[i].hlsl = preamble;
+				write_entry_point_code(module.entry_points[i].hlsl, i);
+			});
+		}
+	}
+	void write_entry_point_code(std::string &s, size_t entry_point_index)
+	{
+		const entry_point_code &entry_point = _entry_points_code[entry_point_index];
+
+		std::unordered_set<id> referenced_functions;
+		for (const id function : entry_point.functions)
+		{
+			referenced_functions.insert(function);
+
+			const function_info &info = find_function(function);
+			referenced_functions.insert(info.referenced_functions.begin(), info.referenced_functions.end());
+		}
+
+		// Skip the code of all functions that are not referenced by this entry point, as well as the code of all other entry points
+		std::vector<std::pair<size_t, size_t>> skip_ranges;
+		for (size_t i = 0; i < _functions.size(); ++i)
+			if (referenced_functions.find(_functions[i]->definition) == referenced_functions.end())
+				skip_ranges.push_back(_function_ranges[i]);
+		for (size_t i = 0; i < _entry_points_code.size(); ++i)
+			if (i != entry_point_index)
+				skip_ranges.push_back(_entry_points_code[i].range);
+
+		std::sort(skip_ranges.begin(), skip_ranges.end());
+
+		const std::string &code = _blocks.at(0);
+
+		size_t offset = 0;
+		for (const std::pair<size_t, size_t> &range : skip_ranges)
+		{
+			if (range.first > offset)
+				s.append(code, offset, range.first - offset);
+			offset = std::max(offset, range.second);
+		}
+
+		s.append(code, offset);
 	}
 
 	template <bool is_param = false, bool is_decl = true>
@@ -241,7 +308,7 @@ private:
 					break;
 				}
 				if (std::isinf(data.as_float[i])) {
-					s += std::signbit(data.as_float[i]) ? "1.#INF" : "-1.#INF";
+					s += std::signbit(data.as_float[i]) ? "-1.#INF" : "1.#INF";
 					break;
 				}
 				char temp[64]; // Will be null-terminated by snprintf
@@ -262,7 +329,7 @@ private:
 	template <bool force_source = false>
 	void write_location(std::string &s, const location &loc)
 	{
-		if (loc.source.empty() || !_debug_info)
+		if (loc.source == 0 || _sources == nullptr || !_debug_info)
 			return;
 
 		s += "#line " + std::to_string(loc.line);
@@ -272,11 +339,11 @@ private:
 		// Avoid writing the file name every time to reduce output text size
 		if constexpr (force_source)
 		{
-			s += " \"" + loc.source + '\"';
+			s += " \"" + (*_sources)[loc.source] + '\"';
 		}
 		else if (loc.source != _current_location)
 		{
-			s += " \"" + loc.source + '\"';
+			s += " \"" + (*_sources)[loc.source] + '\"';
 
 			_current_location = loc.source;
 		}
@@ -309,9 +376,20 @@ private:
 				return; // Filter out names that may clash with automatic ones
 		name = escape_name(std::move(name));
 		if constexpr (naming_type == naming::general)
-			if (std::find_if(_names.begin(), _names.end(), [&name](const auto &it) { return it.second == name; }) != _names.end())
+			if (_name_usage.find(name) != _name_usage.end())
 				name += '_' + std::to_string(id); // Append a numbered suffix if the name already exists
-		_names[id] = std::move(name);
+
+		std::string &entry = _names[id];
+		if (!entry.empty())
+			release_name(entry);
+		_name_usage[name]++;
+		entry = std::move(name);
+	}
+	void release_name(const std::string &name)
+	{
+		if (const auto usage_it = _name_usage.find(name);
+			usage_it != _name_usage.end() && --usage_it->second == 0)
+			_name_usage.erase(usage_it);
 	}
 
 	std::string convert_semantic(const std::string &semantic) const
@@ -365,10 +443,24 @@ private:
 		if (block.empty())
 			return;
 
-		for (size_t pos = 0; (pos = block.find("\n\t", pos)) != std::string::npos; pos += 3)
-			block.replace(pos, 2, "\n\t\t");
+		// Build the indented code in a single pass, instead of inserting into the block for every line (which would move all following code every time)
+		std::string indented_block;
+		indented_block.reserve(block.size() + std::count(block.begin(), block.end(), '\n') + 1);
+		indented_block += '\t';
+
+		for (size_t offset = 0, pos; offset < block.size(); offset = pos + 2)
+		{
+			if ((pos = block.find("\n\t", offset)) == std::string::npos)
+			{
+				indented_block.append(block, offset);
+				break;
+			}
+
+			indented_block.append(block, offset, pos - offset);
+			indented_block += "\n\t\t";
+		}
 
-		block.insert(block.begin(), '\t');
+		block = std::move(indented_block);
 	}
 
 	id   define_struct(const location &loc, struct_info &info) override
@@ -658,6 +750,12 @@ private:
 
 		std::string &code = _blocks.at(_current_block);
 
+		// Function code ends after the function body, which is added in 'leave_function'
+		_function_ranges.push_back({ code.size(), code.size() });
+
+		// The code of entry points leaves out the ranges of functions they do not reference, so cannot rely on a file name written before (or in) another range
+		_current_location = 0;
+
 		write_location(code, loc);
 
 		write_type(code, info.return_type);
@@ -717,7 +815,13 @@ private:
 				return;
 		}
 
-		_module.entry_points.push_back({ func.unique_name, stype });
+		_module.entry_points.push_back({ func.unique_name, stype, {}, {} });
+
+		entry_point_code &entry_point_info = _entry_points_code.emplace_back();
+		entry_point_info.functions.push_back(func.definition);
+		entry_point_info.range.first = entry_point_info.range.second = _blocks.at(0).size();
+
+		_current_location = 0;
 
 		// Only have to rewrite the entry point function signature in shader model 3 and for compute (to write "numthreads" attribute)
 		if (_shader_model >= 40 && stype != shader_type::cs)
@@ -844,6 +948,9 @@ private:
 
 		leave_block_and_return(func.return_type.is_void() ? 0 : ret);
 		leave_function();
+
+		entry_point_info.functions.push_back(entry_point.definition);
+		entry_point_info.range.second = _blocks.at(0).size();
 	}
 
 	id   emit_load(const expression &exp, bool force_new_id) override
@@ -1698,11 +1805,21 @@ private:
 	{
 		assert(_last_block != 0);
 
-		_blocks.at(0) += "{\n" + _blocks.at(_last_block) + "}\n";
+		std::string &code = _blocks.at(0);
+
+		code += "{\n";
+		code += _blocks.at(_last_block);
+		code += "}\n";
+
+		_function_ranges.back().second = code.size();
+
+		_current_location = 0;
 	}
 };
 
-codegen *reshadefx::create_codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants)
+codegen *reshadefx::create_codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants, bool optimize)
 {
+	if (optimize)
+		return new codegen_optimizer<codegen_hlsl>(shader_model, debug_info, uniforms_to_spec_constants);
 	return new codegen_hlsl(shader_model, debug_info, uniforms_to_spec_constants);
 }
@@ -0,0 +1,725 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include "effect_codegen.hpp"
+#include <cmath> // std::floor, std::sqrt, std::pow, ...
+#include <unordered_map>
+#include <unordered_set>
+
+namespace reshadefx
+{
+	/// <summary>
+	/// An optimization layer on top of a code generation back-end, which performs constant propagation, identity elimination and strength reduction on the SSA stream before passing it on.
+	/// It also numbers the values computed in each basic block, so that side-effect free operations (like texture fetches and uniform loads) that are repeated with the same operands reuse the earlier result instead.
+	/// </summary>
+	/// <typeparam name="backend">Code generation back-end implementation to optimize the input of.</typeparam>
+	template <typename backend>
+	class codegen_optimizer final : public backend
+	{
+	public:
+		using backend::backend;
+		using typename backend::id;
+
+		bool is_optimizing() const override { return true; }
+
+		id   define_uniform(const location &loc, uniform_info &info) override
+		{
+			const id res = backend::define_uniform(loc, info);
+
+			_uniforms.insert(res);
+
+			return res;
+		}
+		id   define_variable(const location &loc, const type &type, std::string name, bool global, id initializer_value) override
+		{
+			const id res = backend::define_variable(loc, type, std::move(name), global, initializer_value);
+
+			// Variables can be modified, so values computed from them are only equal as long as they were not stored to in between
+			_variable_versions[res] = 0;
+			if (global)
+				_global_variables.push_back(res);
+
+			return res;
+		}
+		id   define_function(const location &loc, function_info &info) override
+		{
+			const id res = backend::define_function(loc, info);
+
+			for (const struct_member_info &param : info.parameter_list)
+				_variable_versions[param.definition] = 0;
+
+			return res;
+		}
+
+		id   emit_load(const expression &exp, bool force_new_id) override
+		{
+			// Resolve access chains on constant values at compile time (e.g. swizzles of a constant vector computed by an earlier folded operation)
+			if (!exp.is_lvalue && !exp.is_constant && !exp.chain.empty())
+			{
+				if (const auto it = _constants.find(exp.base); it != _constants.end())
+				{
+					expression folded;
+					folded.reset_to_rvalue_constant(exp.location, it->second.data, it->second.type);
+
+					for (const expression::operation &op : exp.chain)
+					{
+						if (op.op == expression::operation::op_cast)
+							folded.add_cast_operation(op.to);
+						else if (op.op == expression::operation::op_constant_index)
+							folded.add_constant_index_access(op.index);
+						else if (op.op == expression::operation::op_swizzle)
+							folded.add_swizzle_access(op.swizzle, op.to.rows);
+						else
+							folded.is_constant = false;
+					}
+
+					if (folded.is_constant)
+						return emit_constant(exp.type, folded.constant);
+				}
+			}
+
+			if (exp.is_constant || force_new_id || !this->is_in_block())
+				return backend::emit_load(exp, force_new_id);
+
+			std::string lookup_key = make_load_key(exp);
+
+			if (const id value = find_value(lookup_key))
+			{
+				if (_uniforms.find(exp.base) != _uniforms.end())
+					this->_eliminated_uniform_loads++;
+				else
+					this->_eliminated_operations++;
+				return value;
+			}
+
+			const id res = backend::emit_load(exp, force_new_id);
+
+			// Loads that refer to the base value directly do not emit any code, so there is nothing to reuse
+			if (res != exp.base)
+				_values.emplace(std::move(lookup_key), res);
+
+			return res;
+		}
+		void emit_store(const expression &exp, id value) override
+		{
+			// Storing the value that was loaded from the same location does not change it (e.g. after 'x *= 1.0' was reduced to 'x = x')
+			if (exp.chain.empty() && value == exp.base)
+				return;
+			if (this->is_in_block())
+				if (std::string lookup_key = make_load_key(exp); find_value(lookup_key) == value)
+					return;
+
+			backend::emit_store(exp, value);
+
+			invalidate_values(exp.base);
+		}
+
+		id   emit_constant(const type &type, const constant &data) override
+		{
+			const id res = backend::emit_constant(type, data);
+
+			// Keep track of the values of all constants, so that operations using them can be evaluated at compile time
+			if (!type.is_array() && type.is_numeric())
+				_constants[res] = { type, data };
+
+			return res;
+		}
+
+		id   emit_unary_op(const location &loc, tokenid op, const type &type, id val) override
+		{
+			if (const constant_info *const value = find_constant(val);
+				value != nullptr && (
+				(op == tokenid::minus && !type.is_boolean()) ||
+				(op == tokenid::exclaim && type.is_boolean()) ||
+				(op == tokenid::tilde && type.is_integral() && !type.is_boolean())))
+			{
+				expression folded;
+				folded.reset_to_rvalue_constant(loc, value->data, type);
+				folded.evaluate_constant_expression(op);
+
+				if (is_finite(type, folded.constant))
+					return emit_constant(type, folded.constant);
+			}
+
+			if (!this->is_in_block())
+				return backend::emit_unary_op(loc, op, type, val);
+
+			std::string lookup_key(1, 'u');
+			append_lookup_key(lookup_key, type);
+			append_lookup_key(lookup_key, static_cast<uint32_t>(op));
+			append_operand_key(lookup_key, val);
+
+			if (const id value = find_value(lookup_key))
+				return this->_eliminated_operations++, value;
+
+			return add_value(std::move(lookup_key), backend::emit_unary_op(loc, op, type, val));
+		}
+		id   emit_binary_op(const location &loc, tokenid op, const type &res_type, const type &type, id lhs, id rhs) override
+		{
+			if (!type.is_numeric() || type.is_array())
+				return backend::emit_binary_op(loc, op, res_type, type, lhs, rhs);
+
+			const constant_info *const lhs_value = find_constant(lhs);
+			const constant_info *const rhs_value = find_constant(rhs);
+
+			// Constant propagation
+			if (lhs_value != nullptr && rhs_value != nullptr && can_evaluate_binary_op(plain_binary_op(op), type, rhs_value->data))
+			{
+				expression folded;
+				folded.reset_to_rvalue_constant(loc, lhs_value->data, type);
+
+				if (folded.evaluate_constant_expression(plain_binary_op(op), rhs_value->data) && is_finite(res_type, folded.constant))
+					return emit_constant(res_type, folded.constant);
+			}
+
+			// Identity elimination (only applies to operations that do not change the type)
+			if (res_type == type && (lhs_value != nullptr || rhs_value != nullptr))
+			{
+				const bool is_integer = type.is_integral() && !type.is_boolean();
+
+				switch (plain_binary_op(op))
+				{
+				case tokenid::plus:
+					// Floating-point values are only unchanged by adding negative zero, since -0 + +0 = +0
+					if (is_all(rhs_value, type.is_floating_point() ? -0.0f : 0.0f))
+						return lhs; // x + 0 = x
+					if (is_all(lhs_value, type.is_floating_point() ? -0.0f : 0.0f))
+						return rhs; // 0 + x = x
+					break;
+				case tokenid::minus:
+					if (is_all(rhs_value, 0))
+						return lhs; // x - 0 = x
+					if (is_all(lhs_value, 0) && is_integer && type.is_signed())
+						return emit_unary_op(loc, tokenid::minus, type, rhs); // 0 - x = -x (not true for floating-point values, since +0 - +0 = +0, but -(+0) = -0)
+					break;
+				case tokenid::star:
+					if (is_all(rhs_value, 1))
+						return lhs; // x * 1 = x
+					if (is_all(lhs_value, 1))
+						return rhs; // 1 * x = x
+					if (is_all(rhs_value, 0) && is_integer)
+						return rhs; // x * 0 = 0 (not true for floating-point values, since NaN or infinity times zero is NaN)
+					if (is_all(lhs_value, 0) && is_integer)
+						return lhs; // 0 * x = 0
+					if (is_all(rhs_value, -1) && type.is_signed())
+						return emit_unary_op(loc, tokenid::minus, type, lhs); // x * -1 = -x
+					if (is_all(lhs_value, -1) && type.is_signed())
+						return emit_unary_op(loc, tokenid::minus, type, rhs); // -1 * x = -x
+					break;
+				case tokenid::slash:
+					if (is_all(rhs_value, 1))
+						return lhs; // x / 1 = x
+					// Strength reduction of a division by a power of two into a multiplication with its reciprocal (which is exact)
+					if (rhs_value != nullptr && type.is_floating_point())
+					{
+						constant reciprocal = {};
+						bool is_exact = true;
+						for (unsigned int i = 0; i < type.components() && is_exact; ++i)
+						{
+							int exponent = 0;
+							is_exact = std::isfinite(rhs_value->data.as_float[i]) && std::abs(std::frexp(rhs_value->data.as_float[i], &exponent)) == 0.5f && std::isnormal(1.0f / rhs_value->data.as_float[i]);
+							reciprocal.as_float[i] = 1.0f / rhs_value->data.as_float[i];
+						}
+
+						if (is_exact)
+							return emit_binary_op(loc, tokenid::star, res_type, type, lhs, emit_constant(type, reciprocal));
+					}
+					break;
+				case tokenid::ampersand:
+					if (is_all(rhs_value, -1))
+						return lhs; // x & ~0 = x
+					if (is_all(lhs_value, -1))
+						return rhs; // ~0 & x = x
+					if (is_all(rhs_value, 0))
+						return rhs; // x & 0 = 0
+					if (is_all(lhs_value, 0))
+						return lhs; // 0 & x = 0
+					break;
+				case tokenid::pipe:
+				case tokenid::caret:
+					if (is_all(rhs_value, 0))
+						return lhs; // x | 0 = x
+					if (is_all(lhs_value, 0))
+						return rhs; // 0 | x = x
+					break;
+				case tokenid::less_less:
+				case tokenid::greater_greater:
+					if (is_all(rhs_value, 0))
+						return lhs; // x << 0 = x
+					break;
+				case tokenid::ampersand_ampersand:
+					if (is_all(rhs_value, 1))
+						return lhs; // x && true = x
+					if (is_all(lhs_value, 1))
+						return rhs; // true && x = x
+					if (is_all(rhs_value, 0))
+						return rhs; // x && false = false
+					if (is_all(lhs_value, 0))
+						return lhs; // false && x = false
+					break;
+				case tokenid::pipe_pipe:
+					if (is_all(rhs_value, 0))
+						return lhs; // x || false = x
+					if (is_all(lhs_value, 0))
+						return rhs; // false || x = x
+					if (is_all(rhs_value, 1))
+						return rhs; // x || true = true
+					if (is_all(lhs_value, 1))
+						return lhs; // true || x = true
+					break;
+				default:
+					break;
+				}
+			}
+
+			if (!this->is_in_block())
+				return backend::emit_binary_op(loc, op, res_type, type, lhs, rhs);
+
+			std::string lookup_key(1, 'b');
+			append_lookup_key(lookup_key, res_type);
+			append_lookup_key(lookup_key, type);
+			append_lookup_key(lookup_key, static_cast<uint32_t>(plain_binary_op(op)));
+			append_operand_key(lookup_key, lhs);
+			append_operand_key(lookup_key, rhs);
+
+			if (const id value = find_value(lookup_key))
+				return this->_eliminated_operations++, value;
+
+			return add_value(std::move(lookup_key), backend::emit_binary_op(loc, op, res_type, type, lhs, rhs));
+		}
+		id   emit_ternary_op(const location &loc, tokenid op, const type &type, id condition, id true_value, id false_value) override
+		{
+			if (true_value == false_value)
+				return true_value;
+
+			// Select the value directly if the condition is known at compile time
+			if (const constant_info *const condition_value = find_constant(condition))
+			{
+				if (is_all(condition_value, 1))
+					return true_value;
+				if (is_all(condition_value, 0))
+					return false_value;
+			}
+
+			if (!this->is_in_block())
+				return backend::emit_ternary_op(loc, op, type, condition, true_value, false_value);
+
+			std::string lookup_key(1, 't');
+			append_lookup_key(lookup_key, type);
+			append_lookup_key(lookup_key, static_cast<uint32_t>(op));
+			append_operand_key(lookup_key, condition);
+			append_operand_key(lookup_key, true_value);
+			append_operand_key(lookup_key, false_value);
+
+			if (const id value = find_value(lookup_key))
+				return this->_eliminated_operations++, value;
+
+			return add_value(std::move(lookup_key), backend::emit_ternary_op(loc, op, type, condition, true_value, false_value));
+		}
+		id   emit_call(const location &loc, id function, const type &res_type, const std::vector<expression> &args) override
+		{
+			const id res = backend::emit_call(loc, function, res_type, args);
+
+			// Functions may modify global variables and their parameters
+			for (const id variable : _global_variables)
+				invalidate_values(variable);
+			for (const expression &arg : args)
+				invalidate_values(arg.base);
+
+			return res;
+		}
+		id   emit_call_intrinsic(const location &loc, id intrinsic, const type &res_type, const std::vector<expression> &args) override
+		{
+			enum
+			{
+			#define IMPLEMENT_INTRINSIC_SPIRV(name, i, code) name##i,
+				#include "effect_symbol_table_intrinsics.inl"
+			};
+
+			const constant_info *values[3] = {};
+			bool is_constant = args.size() <= 3;
+			for (size_t i = 0; i < args.size() && i < 3; ++i)
+				is_constant &= (values[i] = find_constant(args[i].base)) != nullptr;
+
+			// Evaluate intrinsics with only constant arguments at compile time
+			if (is_constant && !res_type.is_array())
+			{
+				constant result = {};
+				bool is_folded = true;
+
+				const auto x = [&values](unsigned int i) { return values[0]->data.as_float[i]; };
+				const auto y = [&values](unsigned int i) { return values[1]->data.as_float[i]; };
+				const auto z = [&values](unsigned int i) { return values[2]->data.as_float[i]; };
+
+				for (unsigned int i = 0; i < res_type.components() && is_folded; ++i)
+				{
+					float &r = result.as_float[i];
+
+					switch (intrinsic)
+					{
+					case abs0:
+						// Negate as unsigned, so that the smallest signed integer wraps around to itself (like on the GPU) instead of overflowing
+						result.as_uint[i] = values[0]->data.as_int[i] < 0 ? 0u - values[0]->data.as_uint[i] : values[0]->data.as_uint[i];
+						break;
+					case abs1:
+						r = std::abs(x(i));
+						break;
+					case min0:
+						result.as_int[i] = std::min(values[0]->data.as_int[i], values[1]->data.as_int[i]);
+						break;
+					case min1:
+						r = std::min(x(i), y(i));
+						break;
+					case max0:
+						result.as_int[i] = std::max(values[0]->data.as_int[i], values[1]->data.as_int[i]);
+						break;
+					case max1:
+						r = std::max(x(i), y(i));
+						break;
+					case clamp0:
+						result.as_int[i] = std::min(std::max(values[0]->data.as_int[i], values[1]->data.as_int[i]), values[2]->data.as_int[i]);
+						break;
+					case clamp1:
+						result.as_uint[i] = std::min(std::max(values[0]->data.as_uint[i], values[1]->data.as_uint[i]), values[2]->data.as_uint[i]);
+						break;
+					case clamp2:
+						r = std::min(std::max(x(i), y(i)), z(i));
+						break;
+					case saturate0:
+						r = x(i) > 0.0f ? (x(i) < 1.0f ? x(i) : 1.0f) : 0.0f;
+						break;
+					case sign0:
+						result.as_int[i] = (values[0]->data.as_int[i] > 0) - (values[0]->data.as_int[i] < 0);
+						break;
+					case sign1:
+						r = static_cast<float>((x(i) > 0.0f) - (x(i) < 0.0f));
+						break;
+					case floor0:
+						r = std::floor(x(i));
+						break;
+					case ceil0:
+						r = std::ceil(x(i));
+						break;
+					case frac0:
+						r = x(i) - std::floor(x(i));
+						break;
+					case sqrt0:
+						r = std::sqrt(x(i));
+						break;
+					case rsqrt0:
+						r = 1.0f / std::sqrt(x(i));
+						break;
+					case rcp0:
+						r = 1.0f / x(i);
+						break;
+					case exp0:
+						r = std::exp(x(i));
+						break;
+					case exp20:
+						r = std::exp2(x(i));
+						break;
+					case log0:
+						r = std::log(x(i));
+						break;
+					case log20:
+						r = std::log2(x(i));
+						break;
+					case pow0:
+						r = std::pow(x(i), y(i));
+						break;
+					case sin0:
+						r = std::sin(x(i));
+						break;
+					case cos0:
+						r = std::cos(x(i));
+						break;
+					case radians0:
+						r = x(i) * (3.14159265358979323846f / 180.0f);
+						break;
+					case degrees0:
+						r = x(i) * (180.0f / 3.14159265358979323846f);
+						break;
+					case step0:
+						r = y(i) >= x(i) ? 1.0f : 0.0f;
+						break;
+					case lerp0:
+						r = x(i) + z(i) * (y(i) - x(i));
+						break;
+					case mad0:
+						r = x(i) * y(i) + z(i);
+						break;
+					case dot0:
+						for (unsigned int k = 0; k < args[0].type.components(); ++k)
+							r += x(k) * y(k);
+						break;
+					default:
+						is_folded = false;
+						break;
+					}
+				}
+
+				// Results that are infinity or NaN (e.g. 'log(0.0)') are left to be evaluated at runtime, since not every back-end can express them as a literal
+				if (is_folded && is_finite(res_type, result))
+					return emit_constant(res_type, result);
+			}
+
+			// Strength reduction of power functions with small constant exponents
+			if (intrinsic == pow0 && values[1] != nullptr)
+			{
+				if (is_all(values[1], 1))
+					return args[0].base; // pow(x, 1) = x
+				if (is_all(values[1], 2))
+					return emit_binary_op(loc, tokenid::star, res_type, res_type, args[0].base, args[0].base); // pow(x, 2) = x * x
+
+				if (is_all(values[1], 0.5f))
+					return emit_call_intrinsic(loc, sqrt0, res_type, { args[0] }); // pow(x, 0.5) = sqrt(x)
+			}
+
+			// Minimum or maximum of a value with itself is the value
+			if ((intrinsic == min0 || intrinsic == min1 || intrinsic == max0 || intrinsic == max1) && args[0].base == args[1].base)
+				return args[0].base;
+
+			// Intrinsics without a result, with 'out' parameters or that operate on storage or groupshared memory (like atomics and barriers) have side effects and therefore cannot be reused
+			bool has_side_effects = res_type.is_void();
+			for (const expression &arg : args)
+				has_side_effects |= arg.is_lvalue || arg.type.is_storage() || arg.type.has(type::q_groupshared);
+
+			if (has_side_effects || !this->is_in_block())
+			{
+				const id res = backend::emit_call_intrinsic(loc, intrinsic, res_type, args);
+
+				if (has_side_effects)
+				{
+					for (const id variable : _global_variables)
+						invalidate_values(variable);
+					for (const expression &arg : args)
+						invalidate_values(arg.base);
+				}
+
+				return res;
+			}
+
+			std::string lookup_key(1, 'i');
+			append_lookup_key(lookup_key, res_type);
+			append_lookup_key(lookup_key, intrinsic);
+			for (const expression &arg : args)
+				append_operand_key(lookup_key, arg.base);
+
+			if (const id value = find_value(lookup_key))
+			{
+				if (!args.empty() && args[0].type.is_sampler())
+					this->_eliminated_texture_fetches++;
+				else
+					this->_eliminated_operations++;
+				return value;
+			}
+
+			return add_value(std::move(lookup_key), backend::emit_call_intrinsic(loc, intrinsic, res_type, args));
+		}
+
+		void leave_function() override
+		{
+			backend::leave_function();
+
+			// Values are only reused within the same basic block, so none of them can be referenced outside the function anymore
+			_values.clear();
+		}
+
+	private:
+		struct constant_info
+		{
+			reshadefx::type type;
+			reshadefx::constant data;
+		};
+
+		const constant_info *find_constant(id id) const
+		{
+			if (const auto it = _constants.find(id); it != _constants.end())
+				return &it->second;
+			return nullptr;
+		}
+
+		static void append_lookup_key(std::string &key, uint32_t value)
+		{
+			key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+		}
+		static void append_lookup_key(std::string &key, const type &type)
+		{
+			// Only append the fields that are compared by 'type::operator==' (so not the type qualifiers)
+			const uint32_t words[] = { type.base, type.rows, type.cols, static_cast<uint32_t>(type.array_length), type.definition };
+			key.append(reinterpret_cast<const char *>(words), sizeof(words));
+		}
+		/// <summary>
+		/// Appends an operand to a value lookup key, together with the current version of it if it is a variable.
+		/// </summary>
+		void append_operand_key(std::string &key, id value) const
+		{
+			append_lookup_key(key, value);
+			if (const auto it = _variable_versions.find(value); it != _variable_versions.end())
+				append_lookup_key(key, it->second);
+		}
+
+		/// <summary>
+		/// Builds the lookup key for loading the value of the specified expression.
+		/// </summary>
+		std::string make_load_key(const expression &exp) const
+		{
+			std::string lookup_key(1, 'l');
+			append_lookup_key(lookup_key, exp.type);
+			append_operand_key(lookup_key, exp.base);
+			for (const expression::operation &op : exp.chain)
+			{
+				append_lookup_key(lookup_key, static_cast<uint32_t>(op.op));
+				append_lookup_key(lookup_key, op.from);
+				append_lookup_key(lookup_key, op.to);
+				if (op.op == expression::operation::op_dynamic_index)
+					append_operand_key(lookup_key, op.index);
+				else
+					append_lookup_key(lookup_key, op.index);
+				lookup_key.append(reinterpret_cast<const char *>(op.swizzle), sizeof(op.swizzle));
+			}
+			return lookup_key;
+		}
+
+		/// <summary>
+		/// Looks up a value that was computed before in the current basic block with the specified <paramref name="key"/>, or returns zero if there is none.
+		/// </summary>
+		id find_value(std::string &key) const
+		{
+			append_lookup_key(key, this->_current_block);
+
+			if (const auto it = _values.find(key); it != _values.end())
+				return it->second;
+			return 0;
+		}
+		id add_value(std::string &&key, id value)
+		{
+			_values.emplace(std::move(key), value);
+			return value;
+		}
+
+		/// <summary>
+		/// Discards all values computed from the specified <paramref name="variable"/> after it was modified.
+		/// </summary>
+		void invalidate_values(id variable)
+		{
+			if (const auto it = _variable_versions.find(variable); it != _variable_versions.end())
+				it->second++;
+		}
+
+		/// <summary>
+		/// Checks whether all components of a constant are equal to the specified <paramref name="value"/>.
+		/// Floating-point zeros only match if they have the same sign.
+		/// </summary>
+		static bool is_all(const constant_info *constant, float value)
+		{
+			if (constant == nullptr)
+				return false;
+
+			for (unsigned int i = 0; i < constant->type.components(); ++i)
+				if (constant->type.is_floating_point() ? constant->data.as_float[i] != value || std::signbit(constant->data.as_float[i]) != std::signbit(value) :
+					constant->type.is_boolean() ? (constant->data.as_uint[i] != 0) != (value != 0) :
+					constant->data.as_int[i] != static_cast<int32_t>(value))
+					return false;
+			return true;
+		}
+
+		/// <summary>
+		/// Checks whether all components of a constant are finite (always the case for non-floating-point types).
+		/// </summary>
+		static bool is_finite(const type &type, const constant &data)
+		{
+			if (type.is_floating_point())
+				for (unsigned int i = 0; i < type.components(); ++i)
+					if (!std::isfinite(data.as_float[i]))
+						return false;
+			return true;
+		}
+
+		/// <summary>
+		/// Converts compound assignment and increment/decrement operators to the plain binary operator they evaluate.
+		/// </summary>
+		static tokenid plain_binary_op(tokenid op)
+		{
+			switch (op)
+			{
+			case tokenid::plus_plus:
+			case tokenid::plus_equal:
+				return tokenid::plus;
+			case tokenid::minus_minus:
+			case tokenid::minus_equal:
+				return tokenid::minus;
+			case tokenid::star_equal:
+				return tokenid::star;
+			case tokenid::slash_equal:
+				return tokenid::slash;
+			case tokenid::percent_equal:
+				return tokenid::percent;
+			case tokenid::ampersand_equal:
+				return tokenid::ampersand;
+			case tokenid::pipe_equal:
+				return tokenid::pipe;
+			case tokenid::caret_equal:
+				return tokenid::caret;
+			case tokenid::less_less_equal:
+				return tokenid::less_less;
+			case tokenid::greater_greater_equal:
+				return tokenid::greater_greater;
+			default:
+				return op;
+			}
+		}
+
+		/// <summary>
+		/// Checks whether a binary operation can be evaluated at compile time without running into undefined behavior.
+		/// </summary>
+		static bool can_evaluate_binary_op(tokenid op, const type &type, const constant &rhs)
+		{
+			switch (op)
+			{
+			case tokenid::plus:
+			case tokenid::minus:
+			case tokenid::star:
+			case tokenid::ampersand:
+			case tokenid::ampersand_ampersand:
+			case tokenid::pipe:
+			case tokenid::pipe_pipe:
+			case tokenid::caret:
+			case tokenid::less:
+			case tokenid::less_equal:
+			case tokenid::greater:
+			case tokenid::greater_equal:
+			case tokenid::equal_equal:
+			case tokenid::exclaim_equal:
+				return true;
+			case tokenid::slash:
+			case tokenid::percent:
+				// Avoid the overflow of dividing the smallest signed integer by minus one
+				if (type.is_integral() && type.is_signed())
+					for (unsigned int i = 0; i < type.components(); ++i)
+						if (rhs.as_int[i] == -1)
+							return false;
+				return true;
+			case tokenid::less_less:
+			case tokenid::greater_greater:
+				// Shifting by the bit width or more is undefined
+				for (unsigned int i = 0; i < type.components(); ++i)
+					if (rhs.as_uint[i] >= 32)
+						return false;
+				return type.is_integral();
+			default:
+				return false;
+			}
+		}
+
+		std::unordered_map<id, constant_info> _constants;
+		std::unordered_map<std::string, id> _values;
+		std::unordered_map<id, uint32_t> _variable_versions;
+		std::unordered_set<id> _uniforms;
+		std::vector<id> _global_variables;
+	};
+}
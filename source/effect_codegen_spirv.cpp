@@ -5,9 +5,9 @@
 
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
+#include "effect_codegen_optimizer.hpp"
 #include <cassert>
-#include <cstring> // memcmp
-#include <algorithm> // std::find_if, std::max
+#include <algorithm> // std::all_of, std::find_if, std::max
 #include <unordered_set>
 
 // Use the C++ variant of the SPIR-V headers
@@ -19,25 +19,79 @@ namespace spv {
 using namespace reshadefx;
 
 /// <summary>
-/// A single instruction in a SPIR-V module
+/// A stream of encoded instructions forming a basic block in the SPIR-V module
+/// </summary>
+struct spirv_basic_block
+{
+	std::vector<uint32_t> words;
+
+	/// <summary>
+	/// Append another basic block the end of this one.
+	/// </summary>
+	void append(const spirv_basic_block &block)
+	{
+		words.insert(words.end(), block.words.begin(), block.words.end());
+	}
+
+	/// <summary>
+	/// Remove the label instruction at the end of this block.
+	/// </summary>
+	/// <returns>The result ID of the removed label.</returns>
+	spv::Id pop_label()
+	{
+		assert(words.size() >= 2 && words[words.size() - 2] == ((2u << spv::WordCountShift) | spv::OpLabel));
+
+		const spv::Id label = words.back();
+		words.resize(words.size() - 2);
+		return label;
+	}
+};
+
+/// <summary>
+/// A single instruction in a SPIR-V module, which is encoded directly into the word stream of a basic block
 /// </summary>
 struct spirv_instruction
 {
-	spv::Op op;
-	spv::Id type;
+	// Placeholder for the type of an instruction that is only known after its operands were added (see 'set_type')
+	static constexpr spv::Id deferred_type = ~0u;
+
+	spirv_basic_block *block;
+	size_t offset;
 	spv::Id result;
-	std::vector<spv::Id> operands;
 
-	explicit spirv_instruction(spv::Op op = spv::OpNop) : op(op), type(0), result(0) {}
-	spirv_instruction(spv::Op op, spv::Id result) : op(op), type(result), result(0) {}
-	spirv_instruction(spv::Op op, spv::Id type, spv::Id result) : op(op), type(type), result(result) {}
+	spirv_instruction() : block(nullptr), offset(0), result(0) {}
+	spirv_instruction(spirv_basic_block &block, spv::Op op, spv::Id type = 0, spv::Id result = 0) : block(&block), offset(block.words.size()), result(result)
+	{
+		// See https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html
+		// 0             | Opcode: The 16 high-order bits are the WordCount of the instruction. The 16 low-order bits are the opcode enumerant.
+		// 1             | Optional instruction type <id>
+		// .             | Optional instruction Result <id>
+		// .             | Operand 1 (if needed)
+		// .             | Operand 2 (if needed)
+		// ...           | ...
+		// WordCount - 1 | Operand N (N is determined by WordCount minus the 1 to 3 words used for the opcode, instruction type <id>, and instruction Result <id>).
+
+		block.words.push_back((1u << spv::WordCountShift) | op);
+
+		// Optional instruction type ID
+		if (type != 0)
+			add(type);
+
+		// Optional instruction result ID
+		if (result != 0)
+			add(result);
+	}
 
 	/// <summary>
 	/// Add a single operand to the instruction.
 	/// </summary>
 	spirv_instruction &add(spv::Id operand)
 	{
-		operands.push_back(operand);
+		// Operands are stored right after the instruction, so it has to be the last one in the block still
+		assert(offset + num_words() == block->words.size());
+
+		block->words.push_back(operand);
+		block->words[offset] += 1u << spv::WordCountShift;
 		return *this;
 	}
 
@@ -47,7 +101,10 @@ struct spirv_instruction
 	template <typename It>
 	spirv_instruction &add(It begin, It end)
 	{
-		operands.insert(operands.end(), begin, end);
+		assert(offset + num_words() == block->words.size());
+
+		block->words.insert(block->words.end(), begin, end);
+		block->words[offset] += static_cast<uint32_t>(std::distance(begin, end)) << spv::WordCountShift;
 		return *this;
 	}
 
@@ -67,53 +124,18 @@ struct spirv_instruction
 	}
 
 	/// <summary>
-	/// Write this instruction to a SPIR-V module.
+	/// Fill in the type of an instruction that was created with a <see cref="deferred_type"/>.
 	/// </summary>
-	/// <param name="output">The output stream to append this instruction to.</param>
-	void write(std::vector<uint32_t> &output) const
+	void set_type(spv::Id type)
 	{
-		// See https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html
-		// 0             | Opcode: The 16 high-order bits are the WordCount of the instruction. The 16 low-order bits are the opcode enumerant.
-		// 1             | Optional instruction type <id>
-		// .             | Optional instruction Result <id>
-		// .             | Operand 1 (if needed)
-		// .             | Operand 2 (if needed)
-		// ...           | ...
-		// WordCount - 1 | Operand N (N is determined by WordCount minus the 1 to 3 words used for the opcode, instruction type <id>, and instruction Result <id>).
-
-		const uint32_t num_words = 1 + (type != 0) + (result != 0) + static_cast<uint32_t>(operands.size());
-		output.push_back((num_words << spv::WordCountShift) | op);
-
-		// Optional instruction type ID
-		if (type != 0)
-			output.push_back(type);
-
-		// Optional instruction result ID
-		if (result != 0)
-			output.push_back(result);
-
-		// Write out the operands
-		output.insert(output.end(), operands.begin(), operands.end());
+		assert(block->words[offset + 1] == deferred_type);
+		block->words[offset + 1] = type;
 	}
-};
 
-/// <summary>
-/// A list of instructions forming a basic block in the SPIR-V module
-/// </summary>
-struct spirv_basic_block
-{
-	std::vector<spirv_instruction> instructions;
-
-	/// <summary>
-	/// Append another basic block the end of this one.
-	/// </summary>
-	void append(const spirv_basic_block &block)
-	{
-		instructions.insert(instructions.end(), block.instructions.begin(), block.instructions.end());
-	}
+	uint32_t num_words() const { return block->words[offset] >> spv::WordCountShift; }
 };
 
-class codegen_spirv final : public codegen
+class codegen_spirv : public codegen
 {
 public:
 	codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y)
@@ -122,7 +144,7 @@ public:
 		_glsl_ext = make_id();
 	}
 
-private:
+protected:
 	struct type_lookup
 	{
 		reshadefx::type type;
@@ -134,6 +156,32 @@ private:
 		{
 			return lhs.type == rhs.type && lhs.is_ptr == rhs.is_ptr && lhs.array_stride == rhs.array_stride && lhs.storage == rhs.storage;
 		}
+
+		struct hash
+		{
+			size_t operator()(const type_lookup &lookup) const
+			{
+				// Only combine the fields that are compared for equality above (so not the type qualifiers)
+				size_t hash = lookup.type.base;
+				hash = hash * 31 + lookup.type.rows;
+				hash = hash * 31 + lookup.type.cols;
+				hash = hash * 31 + static_cast<size_t>(lookup.type.array_length);
+				hash = hash * 31 + lookup.type.definition;
+				hash = hash * 31 + lookup.is_ptr;
+				hash = hash * 31 + lookup.array_stride;
+				hash = hash * 31 + lookup.storage.first;
+				hash = hash * 31 + lookup.storage.second;
+				return hash;
+			}
+		};
+	};
+	struct global_offsets
+	{
+		size_t entries;
+		size_t execution_modes;
+		size_t debug;
+		size_t annotations;
+		size_t variables;
 	};
 	struct function_blocks
 	{
@@ -143,16 +191,16 @@ private:
 		type return_type;
 		std::vector<type> param_types;
 		bool is_entry_point = false;
-
-		friend bool operator==(const function_blocks &lhs, const function_blocks &rhs)
-		{
-			if (lhs.param_types.size() != rhs.param_types.size())
-				return false;
-			for (size_t i = 0; i < lhs.param_types.size(); ++i)
-				if (!(lhs.param_types[i] == rhs.param_types[i]))
-					return false;
-			return lhs.return_type == rhs.return_type;
-		}
+		id definition_id = 0;
+		// Range of the instructions that were added to the global blocks while this function was defined (e.g. names of local variables)
+		global_offsets globals_begin = {}, globals_end = {};
+	};
+	struct entry_point_code
+	{
+		// Functions this entry point consists of (the function it refers to and the glue function generated for it)
+		std::vector<id> functions;
+		// Range of the instructions that were added to the global blocks for this entry point (e.g. the entry point declaration and interface variables)
+		global_offsets globals_begin = {}, globals_end = {};
 	};
 
 	spirv_basic_block _entries;
@@ -165,14 +213,16 @@ private:
 
 	std::unordered_set<spv::Id> _spec_constants;
 	std::unordered_set<spv::Capability> _capabilities;
-	std::vector<std::pair<type_lookup, spv::Id>> _type_lookup;
-	std::vector<std::tuple<type, constant, spv::Id>> _constant_lookup;
-	std::vector<std::pair<function_blocks, spv::Id>> _function_type_lookup;
-	std::unordered_map<std::string, spv::Id> _string_lookup;
+	std::unordered_map<type_lookup, spv::Id, type_lookup::hash> _type_lookup;
+	// Constants and function types are looked up by a binary key built from the values they are compared by (see 'append_lookup_key')
+	std::unordered_map<std::string, spv::Id> _constant_lookup;
+	std::unordered_map<std::string, spv::Id> _function_type_lookup;
+	std::unordered_map<uint32_t, spv::Id> _string_lookup;
 	std::unordered_map<spv::Id, std::pair<spv::StorageClass, spv::ImageFormat>> _storage_lookup;
 	std::unordered_map<std::string, uint32_t> _semantic_to_location;
 
 	std::vector<function_blocks> _functions_blocks;
+	std::vector<entry_point_code> _entry_points_code;
 	std::unordered_map<id, spirv_basic_block> _block_data;
 	spirv_basic_block *_current_block_data = nullptr;
 
@@ -189,7 +239,7 @@ private:
 
 	inline void add_location(const location &loc, spirv_basic_block &block)
 	{
-		if (loc.source.empty() || !_debug_info)
+		if (loc.source == 0 || _sources == nullptr || !_debug_info)
 			return;
 
 		spv::Id file;
@@ -199,7 +249,7 @@ private:
 			file = it->second;
 		else {
 			add_instruction(spv::OpString, 0, _debug_a, file)
-				.add_string(loc.source.c_str());
+				.add_string((*_sources)[loc.source].c_str());
 			_string_lookup.emplace(loc.source, file);
 		}
 
@@ -209,134 +259,780 @@ private:
 			.add(loc.line)
 			.add(loc.column);
 	}
-	inline spirv_instruction &add_instruction(spv::Op op, spv::Id type = 0)
+	inline spirv_instruction add_instruction(spv::Op op, spv::Id type = 0)
 	{
 		assert(is_in_function() && is_in_block());
 		return add_instruction(op, type, *_current_block_data);
 	}
-	inline spirv_instruction &add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block)
+	inline spirv_instruction add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block)
 	{
-		spirv_instruction &instruction = add_instruction_without_result(op, block);
-		instruction.type = type;
-		instruction.result = make_id();
-		return instruction;
+		return spirv_instruction(block, op, type, make_id());
 	}
-	inline spirv_instruction &add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block, spv::Id &result)
+	inline spirv_instruction add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block, spv::Id &result)
 	{
-		spirv_instruction &instruction = add_instruction_without_result(op, block);
-		instruction.type = type;
-		instruction.result = result = make_id();
-		return instruction;
+		return spirv_instruction(block, op, type, result = make_id());
 	}
-	inline spirv_instruction &add_instruction_without_result(spv::Op op)
+	inline spirv_instruction add_instruction_without_result(spv::Op op)
 	{
 		assert(is_in_function() && is_in_block());
 		return add_instruction_without_result(op, *_current_block_data);
 	}
-	inline spirv_instruction &add_instruction_without_result(spv::Op op, spirv_basic_block &block)
+	inline spirv_instruction add_instruction_without_result(spv::Op op, spirv_basic_block &block)
 	{
-		return block.instructions.emplace_back(op);
+		return spirv_instruction(block, op);
 	}
 
-	void write_result(module &module) override
+	void write_result(module &module, bool split_entry_points, const parallel_for_function &executor) override
 	{
 		// First initialize the UBO type now that all member types are known
 		if (_global_ubo_type != 0)
 		{
-			spirv_instruction &type_inst = add_instruction_without_result(spv::OpTypeStruct, _types_and_constants);
-			type_inst.add(_global_ubo_types.begin(), _global_ubo_types.end());
-			type_inst.result = _global_ubo_type;
+			spirv_instruction(_types_and_constants, spv::OpTypeStruct, 0, _global_ubo_type)
+				.add(_global_ubo_types.begin(), _global_ubo_types.end());
+
+			const spv::Id variable_type = convert_type({ type::t_struct, 0, 0, type::q_uniform, 0, _global_ubo_type }, true, spv::StorageClassUniform);
 
-			spirv_instruction &variable_inst = add_instruction_without_result(spv::OpVariable, _variables);
-			variable_inst.add(spv::StorageClassUniform);
-			variable_inst.type = convert_type({ type::t_struct, 0, 0, type::q_uniform, 0, _global_ubo_type }, true, spv::StorageClassUniform);
-			variable_inst.result = _global_ubo_variable;
+			spirv_instruction(_variables, spv::OpVariable, variable_type, _global_ubo_variable)
+				.add(spv::StorageClassUniform);
 
-			add_name(variable_inst.result, "$Globals");
+			add_name(_global_ubo_variable, "$Globals");
 		}
 
 		module = std::move(_module);
 
+		// The whole module and every entry point are written to separate vectors and only read the generated code, so they can be written concurrently
+		parallel_for(split_entry_points ? 1 + module.entry_points.size() : 1, executor, [this, &module](size_t i) {
+			if (i == 0)
+				write_module(module.spirv, nullptr);
+			else
+				write_module(module.entry_points[i - 1].spirv, &_entry_points_code[i - 1]);
+		});
+	}
+	void write_module(std::vector<uint32_t> &spirv, const entry_point_code *entry_point)
+	{
+		// Collect the ranges of all instructions in the global blocks that belong to other entry points or functions not referenced by the specified entry point
+		std::unordered_set<id> referenced_functions;
+		std::vector<std::pair<global_offsets, global_offsets>> skip_ranges;
+
+		if (entry_point != nullptr)
+		{
+			for (const id function : entry_point->functions)
+			{
+				referenced_functions.insert(function);
+
+				const function_info &info = find_function(function);
+				referenced_functions.insert(info.referenced_functions.begin(), info.referenced_functions.end());
+			}
+
+			for (const function_blocks &function : _functions_blocks)
+				if (referenced_functions.find(function.definition_id) == referenced_functions.end())
+					skip_ranges.push_back({ function.globals_begin, function.globals_end });
+			for (const entry_point_code &other_entry_point : _entry_points_code)
+				if (&other_entry_point != entry_point)
+					skip_ranges.push_back({ other_entry_point.globals_begin, other_entry_point.globals_end });
+		}
+
+		const auto write = [&spirv](const spirv_basic_block &block) {
+			spirv.insert(spirv.end(), block.words.begin(), block.words.end());
+		};
+		const auto write_except_skipped = [&spirv, &skip_ranges](const spirv_basic_block &block, size_t global_offsets::*block_offset) {
+			std::vector<std::pair<size_t, size_t>> block_skip_ranges;
+			block_skip_ranges.reserve(skip_ranges.size());
+			for (const std::pair<global_offsets, global_offsets> &range : skip_ranges)
+				block_skip_ranges.push_back({ range.first.*block_offset, range.second.*block_offset });
+			std::sort(block_skip_ranges.begin(), block_skip_ranges.end());
+
+			size_t offset = 0;
+			for (const std::pair<size_t, size_t> &range : block_skip_ranges)
+			{
+				if (range.first > offset)
+					spirv.insert(spirv.end(), block.words.begin() + offset, block.words.begin() + range.first);
+
+				// Types may be declared while defining a function, but are shared with all other functions, so keep any decorations of those
+				for (size_t inst = std::max(offset, range.first); inst < range.second; inst += block.words[inst] >> spv::WordCountShift)
+					if ((block.words[inst] & spv::OpCodeMask) == spv::OpDecorate && block.words[inst + 2] == spv::DecorationArrayStride)
+						spirv.insert(spirv.end(), block.words.begin() + inst, block.words.begin() + inst + (block.words[inst] >> spv::WordCountShift));
+
+				offset = std::max(offset, range.second);
+			}
+
+			spirv.insert(spirv.end(), block.words.begin() + offset, block.words.end());
+		};
+
 		// Write SPIRV header info
-		module.spirv.push_back(spv::MagicNumber);
-		module.spirv.push_back(0x10300); // Force SPIR-V 1.3
-		module.spirv.push_back(0u); // Generator magic number, see https://www.khronos.org/registry/spir-v/api/spir-v.xml
-		module.spirv.push_back(_next_id); // Maximum ID
-		module.spirv.push_back(0u); // Reserved for instruction schema
+		spirv.push_back(spv::MagicNumber);
+		spirv.push_back(0x10300); // Force SPIR-V 1.3
+		spirv.push_back(0u); // Generator magic number, see https://www.khronos.org/registry/spir-v/api/spir-v.xml
+		spirv.push_back(_next_id); // Maximum ID
+		spirv.push_back(0u); // Reserved for instruction schema
+
+		// Encode the instructions that are only known now into separate blocks, which are then written out together with all others
+		spirv_basic_block header, source;
 
 		// All capabilities
-		spirv_instruction(spv::OpCapability)
-			.add(spv::CapabilityShader) // Implicitly declares the Matrix capability too
-			.write(module.spirv);
+		add_instruction_without_result(spv::OpCapability, header)
+			.add(spv::CapabilityShader); // Implicitly declares the Matrix capability too
 
 		for (spv::Capability capability : _capabilities)
-			spirv_instruction(spv::OpCapability)
-				.add(capability)
-				.write(module.spirv);
+			add_instruction_without_result(spv::OpCapability, header)
+				.add(capability);
 
 		// Optional extension instructions
-		spirv_instruction(spv::OpExtInstImport, _glsl_ext)
-			.add_string("GLSL.std.450") // Import GLSL extension
-			.write(module.spirv);
+		spirv_instruction(header, spv::OpExtInstImport, 0, _glsl_ext)
+			.add_string("GLSL.std.450"); // Import GLSL extension
 
 		// Single required memory model instruction
-		spirv_instruction(spv::OpMemoryModel)
+		add_instruction_without_result(spv::OpMemoryModel, header)
 			.add(spv::AddressingModelLogical)
-			.add(spv::MemoryModelGLSL450)
-			.write(module.spirv);
+			.add(spv::MemoryModelGLSL450);
+
+		add_instruction_without_result(spv::OpSource, source)
+			.add(spv::SourceLanguageUnknown) // ReShade FX is not a reserved token at the moment
+			.add(0); // Language version, TODO: Maybe fill in ReShade version here?
+
+		size_t total_words = spirv.size() + header.words.size() + _entries.words.size() + _execution_modes.words.size() + source.words.size() + _annotations.words.size() + _types_and_constants.words.size() + _variables.words.size();
+		if (_debug_info)
+			total_words += _debug_a.words.size() + _debug_b.words.size();
+		for (const function_blocks &function : _functions_blocks)
+			total_words += function.declaration.words.size() + function.variables.words.size() + function.definition.words.size();
+		spirv.reserve(total_words);
+
+		write(header);
 
 		// All entry point declarations
-		for (const auto &node : _entries.instructions)
-			node.write(module.spirv);
+		write_except_skipped(_entries, &global_offsets::entries);
 
 		// All execution mode declarations
-		for (const auto &node : _execution_modes.instructions)
-			node.write(module.spirv);
+		write_except_skipped(_execution_modes, &global_offsets::execution_modes);
 
-		spirv_instruction(spv::OpSource)
-			.add(spv::SourceLanguageUnknown) // ReShade FX is not a reserved token at the moment
-			.add(0) // Language version, TODO: Maybe fill in ReShade version here?
-			.write(module.spirv);
+		write(source);
 
 		if (_debug_info)
 		{
 			// All debug instructions
-			for (const auto &node : _debug_a.instructions)
-				node.write(module.spirv);
-			for (const auto &node : _debug_b.instructions)
-				node.write(module.spirv);
+			write(_debug_a);
+			write_except_skipped(_debug_b, &global_offsets::debug);
 		}
 
 		// All annotation instructions
-		for (const auto &node : _annotations.instructions)
-			node.write(module.spirv);
+		write_except_skipped(_annotations, &global_offsets::annotations);
 
 		// All type declarations
-		for (const auto &node : _types_and_constants.instructions)
-			node.write(module.spirv);
-		for (const auto &node : _variables.instructions)
-			node.write(module.spirv);
+		write(_types_and_constants);
+		write_except_skipped(_variables, &global_offsets::variables);
 
 		// All function definitions
-		for (const auto &function : _functions_blocks)
+		for (const function_blocks &function : _functions_blocks)
 		{
-			if (function.definition.instructions.empty())
+			if (function.definition.words.empty())
+				continue;
+			if (entry_point != nullptr && referenced_functions.find(function.definition_id) == referenced_functions.end())
 				continue;
 
-			for (const auto &node : function.declaration.instructions)
-				node.write(module.spirv);
+			write(function.declaration);
 
 			// Grab first label and move it in front of variable declarations
-			function.definition.instructions.front().write(module.spirv);
-			assert(function.definition.instructions.front().op == spv::OpLabel);
+			assert(function.definition.words[0] == ((2u << spv::WordCountShift) | spv::OpLabel));
+			spirv.insert(spirv.end(), function.definition.words.begin(), function.definition.words.begin() + 2);
+
+			write(function.variables);
+			spirv.insert(spirv.end(), function.definition.words.begin() + 2, function.definition.words.end());
+		}
+
+		assert(has_valid_annotation_targets(spirv));
+	}
+
+	/// <summary>
+	/// Checks that every ID named or decorated in the specified SPIR-V module is also referenced by an instruction that is not a debug or annotation instruction, so that no decoration is left behind for code that was never written.
+	/// </summary>
+	static bool has_valid_annotation_targets(const std::vector<uint32_t> &spirv)
+	{
+		std::unordered_set<uint32_t> referenced_ids;
+		std::vector<uint32_t> annotated_ids;
+
+		// Skip the header (magic number, version, generator magic number, maximum ID and instruction schema)
+		for (size_t inst = 5, word_count; inst < spirv.size(); inst += word_count)
+		{
+			word_count = spirv[inst] >> spv::WordCountShift;
+			if (word_count == 0 || inst + word_count > spirv.size())
+				return false;
+
+			switch (spirv[inst] & spv::OpCodeMask)
+			{
+			case spv::OpName:
+			case spv::OpMemberName:
+			case spv::OpDecorate:
+			case spv::OpMemberDecorate:
+				annotated_ids.push_back(spirv[inst + 1]);
+				break;
+			default:
+				// This treats literals as IDs too, which can only hide errors, never report false ones
+				referenced_ids.insert(spirv.begin() + inst + 1, spirv.begin() + inst + word_count);
+				break;
+			}
+		}
+
+		return std::all_of(annotated_ids.begin(), annotated_ids.end(),
+			[&referenced_ids](uint32_t id) { return referenced_ids.find(id) != referenced_ids.end(); });
+	}
 
-			for (const auto &node : function.variables.instructions)
-				node.write(module.spirv);
-			for (auto it = function.definition.instructions.begin() + 1; it != function.definition.instructions.end(); ++it)
-				it->write(module.spirv);
+	global_offsets current_global_offsets() const
+	{
+		return { _entries.words.size(), _execution_modes.words.size(), _debug_b.words.size(), _annotations.words.size(), _variables.words.size() };
+	}
+
+	/// <summary>
+	/// Checks whether the operand at the specified word index of an instruction is a literal rather than an ID (only covers instructions that can appear in function bodies generated by this back-end).
+	/// </summary>
+	static bool is_literal_operand(spv::Op op, uint32_t index)
+	{
+		switch (op)
+		{
+		case spv::OpLine:
+			return index >= 2;
+		case spv::OpExtInst:
+			return index == 4;
+		case spv::OpVectorShuffle:
+		case spv::OpCompositeInsert:
+			return index >= 5;
+		case spv::OpCompositeExtract:
+			return index >= 4;
+		case spv::OpLoopMerge:
+			return index >= 3;
+		case spv::OpSelectionMerge:
+			return index >= 2;
+		case spv::OpSwitch:
+			return index >= 3 && (index - 3) % 2 == 0;
+		case spv::OpLoad:
+		case spv::OpBranchConditional:
+			return index >= 4;
+		case spv::OpStore:
+			return index >= 3;
+		case spv::OpImageSampleImplicitLod:
+		case spv::OpImageSampleExplicitLod:
+		case spv::OpImageFetch:
+		case spv::OpImageRead:
+			return index == 5; // Image operands mask
+		case spv::OpImageGather:
+			return index == 6;
+		case spv::OpImageWrite:
+			return index == 4;
+		default:
+			return false;
 		}
 	}
 
+	/// <summary>
+	/// Promotes local variables that are only ever loaded from and stored to directly (not through access chains or function calls) to SSA values.
+	/// This removes all their loads and stores, inserting phi instructions where different values of a variable reach the same block.
+	/// </summary>
+	void promote_local_variables(function_blocks &function)
+	{
+		constexpr size_t no_block = ~size_t(0);
+
+		std::vector<uint32_t> &words = function.definition.words;
+
+		const auto op_at = [&words](size_t inst) { return static_cast<spv::Op>(words[inst] & spv::OpCodeMask); };
+		const auto next_inst = [&words](size_t inst) { return inst + (words[inst] >> spv::WordCountShift); };
+
+		// Split the function into basic blocks and build the control flow graph
+		struct block_info
+		{
+			size_t begin, terminator = 0, end = 0;
+			std::vector<size_t> successors, predecessors;
+		};
+
+		std::vector<block_info> blocks;
+		std::unordered_map<spv::Id, size_t> label_to_block;
+
+		for (size_t inst = 0; inst < words.size(); inst = next_inst(inst))
+		{
+			switch (op_at(inst))
+			{
+			case spv::OpLabel:
+				label_to_block.emplace(words[inst + 1], blocks.size());
+				blocks.push_back({ inst, 0, 0, {}, {} });
+				break;
+			case spv::OpBranch:
+			case spv::OpBranchConditional:
+			case spv::OpSwitch:
+			case spv::OpReturn:
+			case spv::OpReturnValue:
+			case spv::OpKill:
+			case spv::OpUnreachable:
+				assert(!blocks.empty());
+				blocks.back().terminator = inst;
+				blocks.back().end = next_inst(inst);
+				break;
+			default:
+				break;
+			}
+		}
+
+		if (blocks.empty())
+			return;
+
+		for (size_t b = 0; b < blocks.size(); ++b)
+		{
+			const size_t inst = blocks[b].terminator;
+			const uint32_t num_words = words[inst] >> spv::WordCountShift;
+
+			const auto add_successor = [&](spv::Id label) {
+				const size_t s = label_to_block.at(label);
+				if (std::find(blocks[b].successors.begin(), blocks[b].successors.end(), s) != blocks[b].successors.end())
+					return;
+				blocks[b].successors.push_back(s);
+				blocks[s].predecessors.push_back(b);
+			};
+
+			switch (op_at(inst))
+			{
+			case spv::OpBranch:
+				add_successor(words[inst + 1]);
+				break;
+			case spv::OpBranchConditional:
+				add_successor(words[inst + 2]);
+				add_successor(words[inst + 3]);
+				break;
+			case spv::OpSwitch:
+				add_successor(words[inst + 2]);
+				for (uint32_t i = 4; i < num_words; i += 2)
+					add_successor(words[inst + i]);
+				break;
+			default:
+				break;
+			}
+		}
+
+		// Order reachable blocks in reverse post-order, so that every block comes after its dominators
+		std::vector<size_t> order;
+		std::vector<size_t> order_index(blocks.size(), no_block);
+		{
+			std::vector<bool> visited(blocks.size());
+			std::vector<std::pair<size_t, size_t>> stack;
+			stack.emplace_back(0, 0);
+			visited[0] = true;
+
+			while (!stack.empty())
+			{
+				const size_t b = stack.back().first;
+				if (const size_t i = stack.back().second++; i < blocks[b].successors.size())
+				{
+					if (const size_t s = blocks[b].successors[i]; !visited[s])
+					{
+						visited[s] = true;
+						stack.emplace_back(s, 0);
+					}
+				}
+				else
+				{
+					order.push_back(b);
+					stack.pop_back();
+				}
+			}
+
+			std::reverse(order.begin(), order.end());
+			for (size_t i = 0; i < order.size(); ++i)
+				order_index[order[i]] = i;
+		}
+
+		// Compute immediate dominators (see "A Simple, Fast Dominance Algorithm" by Cooper, Harvey and Kennedy)
+		std::vector<size_t> idom(blocks.size(), no_block);
+		idom[0] = 0;
+
+		for (bool changed = true; changed;)
+		{
+			changed = false;
+
+			for (size_t i = 1; i < order.size(); ++i)
+			{
+				const size_t b = order[i];
+
+				size_t new_idom = no_block;
+				for (size_t p : blocks[b].predecessors)
+				{
+					if (idom[p] == no_block)
+						continue;
+
+					if (new_idom == no_block)
+					{
+						new_idom = p;
+						continue;
+					}
+
+					while (p != new_idom)
+					{
+						while (order_index[p] > order_index[new_idom])
+							p = idom[p];
+						while (order_index[new_idom] > order_index[p])
+							new_idom = idom[new_idom];
+					}
+				}
+
+				if (idom[b] != new_idom)
+				{
+					idom[b] = new_idom;
+					changed = true;
+				}
+			}
+		}
+
+		// Compute dominance frontiers
+		std::vector<std::vector<size_t>> frontiers(blocks.size());
+		for (const size_t b : order)
+		{
+			if (blocks[b].predecessors.size() < 2)
+				continue;
+
+			for (size_t runner : blocks[b].predecessors)
+			{
+				if (idom[runner] == no_block)
+					continue; // Skip unreachable predecessors
+
+				for (; runner != idom[b]; runner = idom[runner])
+				{
+					if (std::find(frontiers[runner].begin(), frontiers[runner].end(), b) == frontiers[runner].end())
+						frontiers[runner].push_back(b);
+				}
+			}
+		}
+
+		// Find all local variables whose address is only ever used directly by load and store instructions
+		struct variable_info
+		{
+			spv::Id id = 0;
+			spv::Id initializer = 0;
+			spv::Id value_type = 0;
+			size_t num_references = 0;
+			size_t num_loads_and_stores = 0;
+			spv::Id undefined_value = 0;
+			std::vector<size_t> defining_blocks;
+			std::vector<size_t> upward_exposed_blocks;
+		};
+
+		std::vector<variable_info> variables;
+		std::unordered_map<spv::Id, size_t> variable_lookup;
+
+		for (size_t inst = 0; inst < function.variables.words.size(); inst += function.variables.words[inst] >> spv::WordCountShift)
+		{
+			const uint32_t *const inst_words = function.variables.words.data() + inst;
+			if ((inst_words[0] & spv::OpCodeMask) != spv::OpVariable)
+				continue;
+
+			variable_lookup.emplace(inst_words[2], variables.size());
+
+			variable_info &variable = variables.emplace_back();
+			variable.id = inst_words[2];
+			if ((inst_words[0] >> spv::WordCountShift) > 4)
+				variable.initializer = inst_words[4];
+		}
+
+		if (variables.empty())
+			return;
+
+		for (size_t inst = 0; inst < words.size(); inst = next_inst(inst))
+		{
+			const spv::Op op = op_at(inst);
+			const uint32_t num_words = words[inst] >> spv::WordCountShift;
+
+			for (uint32_t i = 1; i < num_words; ++i)
+			{
+				if (const auto it = variable_lookup.find(words[inst + i]);
+					it != variable_lookup.end())
+				{
+					variable_info &variable = variables[it->second];
+					variable.num_references++;
+
+					if (op == spv::OpLoad && i == 3)
+					{
+						variable.num_loads_and_stores++;
+						variable.value_type = words[inst + 1];
+					}
+					if (op == spv::OpStore && i == 1)
+					{
+						variable.num_loads_and_stores++;
+					}
+				}
+			}
+		}
+
+		std::vector<size_t> promoted(variables.size(), no_block);
+		size_t num_promoted = 0;
+		for (size_t v = 0; v < variables.size(); ++v)
+			if (variables[v].num_references == variables[v].num_loads_and_stores && variables[v].num_references != 0)
+				promoted[v] = num_promoted++;
+
+		if (num_promoted == 0)
+			return;
+
+		const auto promoted_variable = [&](spv::Id pointer) -> variable_info * {
+			if (const auto it = variable_lookup.find(pointer);
+				it != variable_lookup.end() && promoted[it->second] != no_block)
+				return &variables[it->second];
+			return nullptr;
+		};
+
+		// Find the blocks that store to and the blocks that read the incoming value of every variable
+		{
+			std::vector<size_t> stored_in_block(variables.size(), no_block);
+
+			for (const size_t b : order)
+			{
+				for (size_t inst = blocks[b].begin; inst < blocks[b].end; inst = next_inst(inst))
+				{
+					const spv::Op op = op_at(inst);
+					if (op == spv::OpLoad)
+					{
+						if (variable_info *const variable = promoted_variable(words[inst + 3]);
+							variable != nullptr && stored_in_block[variable - variables.data()] != b &&
+							(variable->upward_exposed_blocks.empty() || variable->upward_exposed_blocks.back() != b))
+							variable->upward_exposed_blocks.push_back(b);
+					}
+					else if (op == spv::OpStore)
+					{
+						if (variable_info *const variable = promoted_variable(words[inst + 1]);
+							variable != nullptr && stored_in_block[variable - variables.data()] != b)
+						{
+							stored_in_block[variable - variables.data()] = b;
+							variable->defining_blocks.push_back(b);
+						}
+					}
+				}
+			}
+		}
+
+		// Place phi instructions at the iterated dominance frontier of the blocks storing to a variable, but only where the variable is actually live
+		struct phi_info
+		{
+			size_t variable;
+			spv::Id result;
+			std::vector<spv::Id> values; // One for every predecessor
+		};
+
+		std::vector<std::vector<phi_info>> block_phis(blocks.size());
+		{
+			std::vector<size_t> live_in(blocks.size(), no_block);
+			std::vector<size_t> stored_in(blocks.size(), no_block);
+			std::vector<size_t> has_phi(blocks.size(), no_block);
+			std::vector<size_t> in_worklist(blocks.size(), no_block);
+			std::vector<size_t> worklist;
+
+			for (size_t v = 0; v < variables.size(); ++v)
+			{
+				if (promoted[v] == no_block || variables[v].value_type == 0)
+					continue;
+
+				const variable_info &variable = variables[v];
+
+				for (const size_t b : variable.defining_blocks)
+					stored_in[b] = v;
+
+				// Compute the blocks at whose beginning the variable is live
+				worklist = variable.upward_exposed_blocks;
+				for (const size_t b : worklist)
+					live_in[b] = v;
+				while (!worklist.empty())
+				{
+					const size_t b = worklist.back();
+					worklist.pop_back();
+
+					for (const size_t p : blocks[b].predecessors)
+					{
+						if (live_in[p] != v && stored_in[p] != v && idom[p] != no_block)
+						{
+							live_in[p] = v;
+							worklist.push_back(p);
+						}
+					}
+				}
+
+				// The function entry implicitly defines the initial value of every variable
+				worklist = variable.defining_blocks;
+				worklist.push_back(0);
+				for (const size_t b : worklist)
+					in_worklist[b] = v;
+				while (!worklist.empty())
+				{
+					const size_t b = worklist.back();
+					worklist.pop_back();
+
+					for (const size_t f : frontiers[b])
+					{
+						if (has_phi[f] == v)
+							continue;
+						has_phi[f] = v;
+
+						if (live_in[f] == v)
+							block_phis[f].push_back({ v, make_id(), {} });
+
+						if (in_worklist[f] != v)
+						{
+							in_worklist[f] = v;
+							worklist.push_back(f);
+						}
+					}
+				}
+			}
+		}
+
+		// Walk the blocks in dominator order and track the current value of every promoted variable, replacing loads with it
+		std::unordered_map<spv::Id, spv::Id> replacements;
+		std::vector<bool> removed(words.size());
+		size_t num_removed = 0;
+
+		const auto resolve = [&replacements](spv::Id value) {
+			for (auto it = replacements.find(value); it != replacements.end(); it = replacements.find(value))
+				value = it->second;
+			return value;
+		};
+		const auto undefined_value = [this, &function](variable_info &variable) {
+			if (variable.undefined_value == 0)
+				// Undefined values are put after the variable declarations at the beginning of the function, so they dominate all uses
+				add_instruction(spv::OpUndef, variable.value_type, function.variables, variable.undefined_value);
+			return variable.undefined_value;
+		};
+
+		std::vector<std::vector<spv::Id>> exit_values(blocks.size());
+		for (const size_t b : order)
+		{
+			std::vector<spv::Id> &values = exit_values[b];
+			if (b == 0)
+			{
+				values.resize(num_promoted);
+				for (size_t v = 0; v < variables.size(); ++v)
+					if (promoted[v] != no_block)
+						values[promoted[v]] = variables[v].initializer;
+			}
+			else
+			{
+				values = exit_values[idom[b]];
+			}
+
+			for (const phi_info &phi : block_phis[b])
+				values[promoted[phi.variable]] = phi.result;
+
+			for (size_t inst = blocks[b].begin; inst < blocks[b].end; inst = next_inst(inst))
+			{
+				const spv::Op op = op_at(inst);
+				if (op == spv::OpLoad)
+				{
+					if (variable_info *const variable = promoted_variable(words[inst + 3]))
+					{
+						spv::Id &value = values[promoted[variable - variables.data()]];
+						if (value == 0)
+							value = undefined_value(*variable);
+
+						replacements.emplace(words[inst + 2], value);
+						removed[inst] = true;
+						num_removed++;
+					}
+				}
+				else if (op == spv::OpStore)
+				{
+					if (variable_info *const variable = promoted_variable(words[inst + 1]))
+					{
+						values[promoted[variable - variables.data()]] = resolve(words[inst + 2]);
+						removed[inst] = true;
+						num_removed++;
+					}
+				}
+			}
+		}
+
+		for (const size_t b : order)
+		{
+			for (phi_info &phi : block_phis[b])
+			{
+				variable_info &variable = variables[phi.variable];
+
+				for (const size_t p : blocks[b].predecessors)
+				{
+					spv::Id value = idom[p] != no_block ? exit_values[p][promoted[phi.variable]] : 0;
+					if (value == 0)
+						value = undefined_value(variable);
+					phi.values.push_back(value);
+				}
+			}
+		}
+
+		// Remove phi instructions that merge only a single distinct value (or themselves), which can happen in loops that do not modify a variable
+		for (bool changed = true; changed;)
+		{
+			changed = false;
+
+			for (const size_t b : order)
+			{
+				for (auto it = block_phis[b].begin(); it != block_phis[b].end();)
+				{
+					spv::Id unique_value = 0;
+					bool is_trivial = true;
+					for (spv::Id value : it->values)
+					{
+						value = resolve(value);
+						if (value == it->result || value == unique_value)
+							continue;
+						if (unique_value != 0)
+						{
+							is_trivial = false;
+							break;
+						}
+						unique_value = value;
+					}
+
+					if (is_trivial && unique_value != 0)
+					{
+						replacements.emplace(it->result, unique_value);
+						it = block_phis[b].erase(it);
+						changed = true;
+					}
+					else
+					{
+						++it;
+					}
+				}
+			}
+		}
+
+		// Rewrite the function without the removed instructions, with the inserted phi instructions and with all references to removed values replaced
+		std::vector<uint32_t> new_words;
+		new_words.reserve(words.size());
+
+		for (size_t inst = 0; inst < words.size(); inst = next_inst(inst))
+		{
+			if (removed[inst])
+				continue;
+
+			const spv::Op op = op_at(inst);
+			const uint32_t num_words = words[inst] >> spv::WordCountShift;
+
+			new_words.push_back(words[inst]);
+			for (uint32_t i = 1; i < num_words; ++i)
+				new_words.push_back(is_literal_operand(op, i) ? words[inst + i] : resolve(words[inst + i]));
+
+			if (op == spv::OpLabel)
+			{
+				const size_t b = label_to_block.at(words[inst + 1]);
+
+				for (const phi_info &phi : block_phis[b])
+				{
+					new_words.push_back(static_cast<uint32_t>(3 + 2 * phi.values.size()) << spv::WordCountShift | spv::OpPhi);
+					new_words.push_back(variables[phi.variable].value_type);
+					new_words.push_back(phi.result);
+
+					for (size_t i = 0; i < phi.values.size(); ++i)
+					{
+						new_words.push_back(resolve(phi.values[i]));
+						new_words.push_back(words[blocks[blocks[b].predecessors[i]].begin + 1]);
+					}
+				}
+			}
+		}
+
+		words = std::move(new_words);
+
+		_eliminated_operations += static_cast<unsigned int>(num_removed);
+	}
+
 	spv::Id convert_type(type info, bool is_ptr = false, spv::StorageClass storage = spv::StorageClassFunction, spv::ImageFormat format = spv::ImageFormatUnknown, uint32_t array_stride = 0)
 	{
 		assert(array_stride == 0 || info.is_array());
@@ -356,12 +1052,9 @@ private:
 
 		const type_lookup lookup { info, is_ptr, array_stride, { storage, format } };
 
-		{	const auto it = std::find_if(_type_lookup.begin(), _type_lookup.end(),
-				[&lookup](const auto &lookup_it) {
-					return lookup_it.first == lookup; });
-			if (it != _type_lookup.end())
-				return it->second;
-		}
+		if (const auto it = _type_lookup.find(lookup);
+			it != _type_lookup.end())
+			return it->second;
 
 		spv::Id type, elem_type;
 		if (is_ptr)
@@ -506,18 +1199,20 @@ private:
 			}
 		}
 
-		_type_lookup.push_back({ lookup, type });
+		_type_lookup.emplace(lookup, type);
 
 		return type;
 	}
 	spv::Id convert_type(const function_blocks &info)
 	{
-		{	const auto it = std::find_if(_function_type_lookup.begin(), _function_type_lookup.end(),
-				[&lookup = info](const auto &lookup_it) {
-					return lookup_it.first == lookup; });
-			if (it != _function_type_lookup.end())
-				return it->second;
-		}
+		std::string lookup_key;
+		append_lookup_key(lookup_key, info.return_type);
+		for (const type &param_type : info.param_types)
+			append_lookup_key(lookup_key, param_type);
+
+		if (const auto it = _function_type_lookup.find(lookup_key);
+			it != _function_type_lookup.end())
+			return it->second;
 
 		auto return_type = convert_type(info.return_type);
 		assert(return_type != 0);
@@ -527,15 +1222,26 @@ private:
 		for (const type &param_type : info.param_types)
 			param_type_ids.push_back(convert_type(param_type, true));
 
-		spirv_instruction &inst = add_instruction(spv::OpTypeFunction, 0, _types_and_constants);
+		spirv_instruction inst = add_instruction(spv::OpTypeFunction, 0, _types_and_constants);
 		inst.add(return_type);
 		inst.add(param_type_ids.begin(), param_type_ids.end());
 
-		_function_type_lookup.push_back({ info, inst.result });;
+		_function_type_lookup.emplace(std::move(lookup_key), inst.result);
 
 		return inst.result;
 	}
 
+	static void append_lookup_key(std::string &key, const type &type)
+	{
+		// Only append the fields that are compared by 'type::operator==' (so not the type qualifiers)
+		const uint32_t words[] = { type.base, type.rows, type.cols, static_cast<uint32_t>(type.array_length), type.definition };
+		key.append(reinterpret_cast<const char *>(words), sizeof(words));
+	}
+	static void append_lookup_key(std::string &key, const constant &data)
+	{
+		key.append(reinterpret_cast<const char *>(data.as_uint), sizeof(data.as_uint));
+	}
+
 	uint32_t semantic_to_location(const std::string &semantic, uint32_t max_array_length = 1)
 	{
 		if (semantic.compare(0, 5, "COLOR") == 0)
@@ -659,6 +1365,17 @@ private:
 			.add(decoration)
 			.add(values.begin(), values.end());
 	}
+	inline void add_result_decorations(id id, const type &res_type)
+	{
+		// Instructions in unreachable code are never written to the module, so decorating them would leave behind decorations of undefined IDs
+		if (_unreachable)
+			return;
+
+		if (res_type.has(type::q_precise))
+			add_decoration(id, spv::DecorationNoContraction);
+		if (!_enable_16bit_types && res_type.precision() < 32)
+			add_decoration(id, spv::DecorationRelaxedPrecision);
+	}
 	inline void add_member_name(id id, uint32_t member_index, const char *name)
 	{
 		if (!_debug_info)
@@ -762,15 +1479,43 @@ private:
 	{
 		if (_uniforms_to_spec_constants && info.has_initializer_value)
 		{
+			const size_t first_offset = _types_and_constants.words.size();
 			const id res = emit_constant(info.type, info.initializer_value, true);
 
 			add_name(res, info.name.c_str());
 
-			const auto add_spec_constant = [this](const spirv_instruction &inst, const uniform_info &info, const constant &initializer_value, size_t initializer_offset) {
-				assert(inst.op == spv::OpSpecConstant || inst.op == spv::OpSpecConstantTrue || inst.op == spv::OpSpecConstantFalse);
+			// Specialization constants are never reused, so all instructions belonging to this one were just added to the end of the type and constant block
+			// Constants are encoded as 'opcode, result type, result, value or constituents...', so build a lookup table from result to offset for navigating the constituents below
+			const std::vector<uint32_t> &words = _types_and_constants.words;
+			std::unordered_map<spv::Id, size_t> spec_constant_offsets;
+			for (size_t offset = first_offset; offset < words.size(); offset += words[offset] >> spv::WordCountShift)
+			{
+				switch (words[offset] & spv::OpCodeMask)
+				{
+				case spv::OpSpecConstantTrue:
+				case spv::OpSpecConstantFalse:
+				case spv::OpSpecConstant:
+				case spv::OpSpecConstantComposite:
+					spec_constant_offsets.emplace(words[offset + 2], offset);
+					break;
+				}
+			}
+
+			const auto op_at = [&words](size_t offset) {
+				return static_cast<spv::Op>(words[offset] & spv::OpCodeMask);
+			};
+			const auto num_constituents_at = [&words](size_t offset) {
+				return (words[offset] >> spv::WordCountShift) - 3;
+			};
+			const auto constituent_at = [&words, &spec_constant_offsets](size_t offset, size_t index) {
+				return spec_constant_offsets.at(words[offset + 3 + index]);
+			};
+
+			const auto add_spec_constant = [this, &words, &op_at](size_t offset, const uniform_info &info, const constant &initializer_value, size_t initializer_offset) {
+				assert(op_at(offset) == spv::OpSpecConstant || op_at(offset) == spv::OpSpecConstantTrue || op_at(offset) == spv::OpSpecConstantFalse);
 
 				const uint32_t spec_id = static_cast<uint32_t>(_module.spec_constants.size());
-				add_decoration(inst.result, spv::DecorationSpecId, { spec_id });
+				add_decoration(words[offset + 2], spv::DecorationSpecId, { spec_id });
 
 				uniform_info scalar_info = info;
 				scalar_info.type.rows = 1;
@@ -783,50 +1528,53 @@ private:
 				_module.spec_constants.push_back(scalar_info);
 			};
 
-			const spirv_instruction &base_inst = _types_and_constants.instructions.back();
-			assert(base_inst.result == res);
+			const size_t base_offset = spec_constant_offsets.at(res);
 
 			// External specialization constants need to be scalars
 			if (info.type.is_scalar())
 			{
-				add_spec_constant(base_inst, info, info.initializer_value, 0);
+				add_spec_constant(base_offset, info, info.initializer_value, 0);
 			}
 			else
 			{
-				assert(base_inst.op == spv::OpSpecConstantComposite);
+				assert(op_at(base_offset) == spv::OpSpecConstantComposite);
 
 				// Add each individual scalar component of the constant as a separate external specialization constant
-				for (size_t i = 0; i < (info.type.is_array() ? base_inst.operands.size() : 1); ++i)
+				for (size_t i = 0; i < (info.type.is_array() ? num_constituents_at(base_offset) : 1); ++i)
 				{
 					constant initializer_value = info.initializer_value;
-					spirv_instruction elem_inst = base_inst;
+					size_t elem_offset = base_offset;
 
 					if (info.type.is_array())
 					{
-						elem_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-							[elem = base_inst.operands[i]](const auto &it) { return it.result == elem; });
+						elem_offset = constituent_at(base_offset, i);
 
-						assert(initializer_value.array_data.size() == base_inst.operands.size());
+						assert(initializer_value.array_data.size() == num_constituents_at(base_offset));
 						initializer_value = initializer_value.array_data[i];
+
+						// Elements of scalar arrays do not have any constituents
+						if (op_at(elem_offset) != spv::OpSpecConstantComposite)
+						{
+							add_spec_constant(elem_offset, info, initializer_value, 0);
+							continue;
+						}
 					}
 
-					for (size_t row = 0; row < elem_inst.operands.size(); ++row)
+					for (size_t row = 0; row < num_constituents_at(elem_offset); ++row)
 					{
-						const spirv_instruction &row_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-							[elem = elem_inst.operands[row]](const auto &it) { return it.result == elem; });
+						const size_t row_offset = constituent_at(elem_offset, row);
 
-						if (row_inst.op != spv::OpSpecConstantComposite)
+						if (op_at(row_offset) != spv::OpSpecConstantComposite)
 						{
-							add_spec_constant(row_inst, info, initializer_value, row);
+							add_spec_constant(row_offset, info, initializer_value, row);
 							continue;
 						}
 
-						for (size_t col = 0; col < row_inst.operands.size(); ++col)
+						for (size_t col = 0; col < num_constituents_at(row_offset); ++col)
 						{
-							const spirv_instruction &col_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-								[elem = row_inst.operands[col]](const auto &it) { return it.result == elem; });
+							const size_t col_offset = constituent_at(row_offset, col);
 
-							add_spec_constant(col_inst, info, initializer_value, row * info.type.cols + col);
+							add_spec_constant(col_offset, info, initializer_value, row * info.type.cols + col);
 						}
 					}
 				}
@@ -916,14 +1664,15 @@ private:
 	{
 		assert(storage != spv::StorageClassFunction || _current_function != nullptr);
 
-		spirv_basic_block &block = (storage != spv::StorageClassFunction) ?
+		// Variables declared in unreachable code are never referenced by any other code, so add them to the block that is thrown away rather than keeping them around unused
+		spirv_basic_block &block = _unreachable ? *_current_block_data : (storage != spv::StorageClassFunction) ?
 			_variables : _current_function->variables;
 
 		add_location(loc, block);
 
 		spv::Id res;
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpVariable
-		spirv_instruction &inst = add_instruction(spv::OpVariable, convert_type(type, true, storage, format), block, res)
+		spirv_instruction inst = add_instruction(spv::OpVariable, convert_type(type, true, storage, format), block, res)
 			.add(storage);
 
 		if (initializer_value != 0)
@@ -942,10 +1691,10 @@ private:
 			}
 		}
 
-		if (name != nullptr && *name != '\0')
+		if (name != nullptr && *name != '\0' && !_unreachable)
 			add_name(res, name);
 
-		if (!_enable_16bit_types && type.is_numeric() && type.precision() < 32)
+		if (!_enable_16bit_types && type.is_numeric() && type.precision() < 32 && !_unreachable)
 			add_decoration(res, spv::DecorationRelaxedPrecision);
 
 		_storage_lookup[res] = { storage, format };
@@ -958,6 +1707,7 @@ private:
 
 		auto &function = _functions_blocks.emplace_back();
 		function.return_type = info.return_type;
+		function.globals_begin = current_global_offsets();
 
 		_current_function = &function;
 
@@ -971,6 +1721,8 @@ private:
 			.add(spv::FunctionControlMaskNone)
 			.add(convert_type(function));
 
+		function.definition_id = info.definition;
+
 		if (!info.name.empty())
 			add_name(info.definition, info.name.c_str());
 
@@ -1004,7 +1756,11 @@ private:
 				return;
 		}
 
-		_module.entry_points.push_back({ func.unique_name, stype });
+		_module.entry_points.push_back({ func.unique_name, stype, {}, {} });
+
+		entry_point_code &entry_point_info = _entry_points_code.emplace_back();
+		entry_point_info.functions.push_back(func.definition);
+		entry_point_info.globals_begin = current_global_offsets();
 
 		spv::Id position_variable = 0, point_size_variable = 0;
 		std::vector<spv::Id> inputs_and_outputs;
@@ -1306,6 +2062,9 @@ private:
 			.add(entry_point.definition)
 			.add_string(func.unique_name.c_str())
 			.add(inputs_and_outputs.begin(), inputs_and_outputs.end());
+
+		entry_point_info.functions.push_back(entry_point.definition);
+		entry_point_info.globals_end = current_global_offsets();
 	}
 
 	id   emit_load(const expression &exp, bool) override
@@ -1332,7 +2091,7 @@ private:
 				it != _storage_lookup.end())
 				storage = it->second;
 
-			spirv_instruction *access_chain = nullptr;
+			spirv_instruction access_chain;
 
 			// Check if this is a uniform variable (see 'define_uniform' function above) and dereference it
 			if (result & 0xF0000000)
@@ -1345,7 +2104,7 @@ private:
 				if (is_uniform_bool)
 					base_type.base = type::t_uint;
 
-				access_chain = &add_instruction(spv::OpAccessChain)
+				access_chain = add_instruction(spv::OpAccessChain, spirv_instruction::deferred_type)
 					.add(_global_ubo_variable)
 					.add(emit_constant(member_index));
 			}
@@ -1360,8 +2119,8 @@ private:
 				assert(_current_block_data != &_types_and_constants);
 
 				// Use access chain from uniform if possible, otherwise create new one
-				if (access_chain == nullptr) access_chain =
-					&add_instruction(spv::OpAccessChain).add(result); // Base
+				if (access_chain.block == nullptr) access_chain =
+					add_instruction(spv::OpAccessChain, spirv_instruction::deferred_type).add(result); // Base
 
 				// Ignore first index into 1xN matrices, since they were translated to a vector type in SPIR-V
 				if (exp.chain[0].from.rows == 1 && exp.chain[0].from.cols > 1)
@@ -1371,18 +2130,18 @@ private:
 					exp.chain[i].op == expression::operation::op_member ||
 					exp.chain[i].op == expression::operation::op_dynamic_index ||
 					exp.chain[i].op == expression::operation::op_constant_index); ++i)
-					access_chain->add(exp.chain[i].op == expression::operation::op_dynamic_index ?
+					access_chain.add(exp.chain[i].op == expression::operation::op_dynamic_index ?
 						exp.chain[i].index :
 						emit_constant(exp.chain[i].index)); // Indexes
 
 				base_type = exp.chain[i - 1].to;
-				access_chain->type = convert_type(base_type, true, storage.first, storage.second); // Last type is the result
-				result = access_chain->result;
+				access_chain.set_type(convert_type(base_type, true, storage.first, storage.second)); // Last type is the result
+				result = access_chain.result;
 			}
-			else if (access_chain != nullptr)
+			else if (access_chain.block != nullptr)
 			{
-				access_chain->type = convert_type(base_type, true, storage.first, storage.second, base_type.is_array() ? 16u : 0u);
-				result = access_chain->result;
+				access_chain.set_type(convert_type(base_type, true, storage.first, storage.second, base_type.is_array() ? 16u : 0u));
+				result = access_chain.result;
 			}
 
 			result = add_instruction(spv::OpLoad, convert_type(base_type, false, spv::StorageClassFunction, storage.second))
@@ -1509,7 +2268,7 @@ private:
 							scalar_type.rows = 1;
 							scalar_type.cols = 1;
 
-							spirv_instruction &node = add_instruction(spv::OpCompositeExtract, convert_type(scalar_type))
+							spirv_instruction node = add_instruction(spv::OpCompositeExtract, convert_type(scalar_type))
 								.add(result);
 
 							if (op.from.rows > 1) // Matrix types with a single row are actually vectors, so they don't need the extra index
@@ -1520,7 +2279,7 @@ private:
 							components[c] = node.result;
 						}
 
-						spirv_instruction &node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
+						spirv_instruction node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
 						for (unsigned int c = 0; c < 4 && op.swizzle[c] >= 0; ++c)
 							node.add(components[c]);
 						result = node.result;
@@ -1528,7 +2287,7 @@ private:
 					}
 					else if (op.from.is_vector())
 					{
-						spirv_instruction &node = add_instruction(spv::OpVectorShuffle, convert_type(op.to))
+						spirv_instruction node = add_instruction(spv::OpVectorShuffle, convert_type(op.to))
 							.add(result) // Vector 1
 							.add(result); // Vector 2
 						for (unsigned int c = 0; c < 4 && op.swizzle[c] >= 0; ++c)
@@ -1538,7 +2297,7 @@ private:
 					}
 					else
 					{
-						spirv_instruction &node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
+						spirv_instruction node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
 						for (unsigned int c = 0; c < op.to.rows; ++c)
 							node.add(result);
 						result = node.result;
@@ -1549,7 +2308,7 @@ private:
 				{
 					assert(op.swizzle[1] < 0);
 
-					spirv_instruction &node = add_instruction(spv::OpCompositeExtract, convert_type(op.to))
+					spirv_instruction node = add_instruction(spv::OpCompositeExtract, convert_type(op.to))
 						.add(result); // Composite
 					if (op.from.rows > 1)
 					{
@@ -1606,7 +2365,7 @@ private:
 
 					if (base_type.is_vector())
 					{
-						spirv_instruction &node = add_instruction(spv::OpVectorShuffle, convert_type(base_type))
+						spirv_instruction node = add_instruction(spv::OpVectorShuffle, convert_type(base_type))
 							.add(result) // Vector 1
 							.add(value); // Vector 2
 
@@ -1623,7 +2382,7 @@ private:
 					{
 						assert(op.swizzle[1] < 0);
 
-						spirv_instruction &node = add_instruction(spv::OpCompositeInsert, convert_type(base_type))
+						spirv_instruction node = add_instruction(spv::OpCompositeInsert, convert_type(base_type))
 							.add(value) // Object
 							.add(result); // Composite
 
@@ -1675,8 +2434,8 @@ private:
 		// Ensure that 'access_chain' cannot get invalidated by calls to 'emit_constant' or 'convert_type'
 		assert(_current_block_data != &_types_and_constants);
 
-		spirv_instruction *access_chain =
-			&add_instruction(spv::OpAccessChain).add(exp.base); // Base
+		spirv_instruction access_chain =
+			add_instruction(spv::OpAccessChain, spirv_instruction::deferred_type).add(exp.base); // Base
 
 		// Ignore first index into 1xN matrices, since they were translated to a vector type in SPIR-V
 		if (exp.chain[0].from.rows == 1 && exp.chain[0].from.cols > 1)
@@ -1686,12 +2445,12 @@ private:
 			exp.chain[i].op == expression::operation::op_member ||
 			exp.chain[i].op == expression::operation::op_dynamic_index ||
 			exp.chain[i].op == expression::operation::op_constant_index); ++i)
-			access_chain->add(exp.chain[i].op == expression::operation::op_dynamic_index ?
+			access_chain.add(exp.chain[i].op == expression::operation::op_dynamic_index ?
 				exp.chain[i].index :
 				emit_constant(exp.chain[i].index)); // Indexes
 
-		access_chain->type = convert_type(exp.chain[i - 1].to, true, storage.first, storage.second); // Last type is the result
-		return access_chain->result;
+		access_chain.set_type(convert_type(exp.chain[i - 1].to, true, storage.first, storage.second)); // Last type is the result
+		return access_chain.result;
 	}
 
 	id   emit_constant(uint32_t value)
@@ -1701,7 +2460,7 @@ private:
 	id   emit_constant(const type &type, uint32_t value)
 	{
 		// Create a constant value of the specified type
-		constant data = {}; // Initialize to zero, so that components not set below still have a defined value for the lookup via std::memcmp
+		constant data = {}; // Initialize to zero, so that components not set below still have a defined value for the lookup key
 		for (unsigned int i = 0; i < type.components(); ++i)
 			if (type.is_integral())
 				data.as_uint[i] = value;
@@ -1716,18 +2475,20 @@ private:
 	}
 	id   emit_constant(const type &type, const constant &data, bool spec_constant)
 	{
+		std::string lookup_key;
 		if (!spec_constant) // Specialization constants cannot reuse other constants
 		{
-			const auto it = std::find_if(_constant_lookup.begin(), _constant_lookup.end(),
-				[&type, &data](auto &x) {
-					if (!(std::get<0>(x) == type && std::memcmp(&std::get<1>(x).as_uint[0], &data.as_uint[0], sizeof(uint32_t) * 16) == 0 && std::get<1>(x).array_data.size() == data.array_data.size()))
-						return false;
-					for (size_t i = 0; i < data.array_data.size(); ++i)
-						if (std::memcmp(&std::get<1>(x).array_data[i].as_uint[0], &data.array_data[i].as_uint[0], sizeof(uint32_t) * 16) != 0)
-							return false;
-					return true; });
-			if (it != _constant_lookup.end())
-				return std::get<2>(*it); // Re-use existing constant instead of duplicating the definition
+			lookup_key.reserve(sizeof(uint32_t) * (5 + 16 + 1) + data.array_data.size() * sizeof(data.as_uint));
+			append_lookup_key(lookup_key, type);
+			append_lookup_key(lookup_key, data);
+			const uint32_t array_size = static_cast<uint32_t>(data.array_data.size());
+			lookup_key.append(reinterpret_cast<const char *>(&array_size), sizeof(array_size));
+			for (const constant &elem : data.array_data)
+				append_lookup_key(lookup_key, elem);
+
+			if (const auto it = _constant_lookup.find(lookup_key);
+				it != _constant_lookup.end())
+				return it->second; // Re-use existing constant instead of duplicating the definition
 		}
 
 		spv::Id result;
@@ -1784,7 +2545,7 @@ private:
 			}
 			else
 			{
-				spirv_instruction &node = add_instruction(spec_constant ? spv::OpSpecConstantComposite : spv::OpConstantComposite, convert_type(type), _types_and_constants);
+				spirv_instruction node = add_instruction(spec_constant ? spv::OpSpecConstantComposite : spv::OpConstantComposite, convert_type(type), _types_and_constants);
 				for (unsigned int i = 0; i < type.rows; ++i)
 					node.add(rows[i]);
 
@@ -1810,7 +2571,7 @@ private:
 		if (spec_constant) // Keep track of all specialization constants
 			_spec_constants.insert(result);
 		else
-			_constant_lookup.push_back({ type, data, result });
+			_constant_lookup.emplace(std::move(lookup_key), result);
 
 		return result;
 	}
@@ -1836,7 +2597,7 @@ private:
 
 		add_location(loc, *_current_block_data);
 
-		spirv_instruction &inst = add_instruction(spv_op, convert_type(type));
+		spirv_instruction inst = add_instruction(spv_op, convert_type(type));
 		inst.add(val); // Operand
 
 		return inst.result;
@@ -1946,33 +2707,27 @@ private:
 					.add(row)
 					.result;
 
-				spirv_instruction &inst = add_instruction(spv_op, convert_type(vector_type));
+				spirv_instruction inst = add_instruction(spv_op, convert_type(vector_type));
 				inst.add(lhs_elem); // Operand 1
 				inst.add(rhs_elem); // Operand 2
 
-				if (res_type.has(type::q_precise))
-					add_decoration(inst.result, spv::DecorationNoContraction);
-				if (!_enable_16bit_types && res_type.precision() < 32)
-					add_decoration(inst.result, spv::DecorationRelaxedPrecision);
+				add_result_decorations(inst.result, res_type);
 
 				ids.push_back(inst.result);
 			}
 
-			spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(res_type));
+			spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(res_type));
 			inst.add(ids.begin(), ids.end());
 
 			return inst.result;
 		}
 		else
 		{
-			spirv_instruction &inst = add_instruction(spv_op, convert_type(res_type));
+			spirv_instruction inst = add_instruction(spv_op, convert_type(res_type));
 			inst.add(lhs); // Operand 1
 			inst.add(rhs); // Operand 2
 
-			if (res_type.has(type::q_precise))
-				add_decoration(inst.result, spv::DecorationNoContraction);
-			if (!_enable_16bit_types && res_type.precision() < 32)
-				add_decoration(inst.result, spv::DecorationRelaxedPrecision);
+			add_result_decorations(inst.result, res_type);
 
 			return inst.result;
 		}
@@ -1984,7 +2739,7 @@ private:
 
 		add_location(loc, *_current_block_data);
 
-		spirv_instruction &inst = add_instruction(spv::OpSelect, convert_type(type));
+		spirv_instruction inst = add_instruction(spv::OpSelect, convert_type(type));
 		inst.add(condition); // Condition
 		inst.add(true_value); // Object 1
 		inst.add(false_value); // Object 2
@@ -2000,7 +2755,7 @@ private:
 		add_location(loc, *_current_block_data);
 
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpFunctionCall
-		spirv_instruction &inst = add_instruction(spv::OpFunctionCall, convert_type(res_type));
+		spirv_instruction inst = add_instruction(spv::OpFunctionCall, convert_type(res_type));
 		inst.add(function); // Function
 		for (const expression &arg : args)
 			inst.add(arg.base); // Arguments
@@ -2050,7 +2805,7 @@ private:
 			// Turn the list of scalar arguments into a list of column vectors
 			for (size_t arg = 0; arg < args.size(); arg += vector_type.rows)
 			{
-				spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(vector_type));
+				spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(vector_type));
 				for (unsigned row = 0; row < vector_type.rows; ++row)
 					inst.add(args[arg + row].base);
 
@@ -2066,7 +2821,7 @@ private:
 				ids.push_back(arg.base);
 		}
 
-		spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(type));
+		spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(type));
 		inst.add(ids.begin(), ids.end());
 
 		return inst.result;
@@ -2074,35 +2829,34 @@ private:
 
 	void emit_if(const location &loc, id, id condition_block, id true_statement_block, id false_statement_block, unsigned int selection_control) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		const spv::Id merge_label = _current_block_data->pop_label();
 
 		// Add previous block containing the condition value first
 		_current_block_data->append(_block_data[condition_block]);
 
-		spirv_instruction branch_inst = _current_block_data->instructions.back();
-		assert(branch_inst.op == spv::OpBranchConditional);
-		_current_block_data->instructions.pop_back();
+		// Remove the branch instruction at the end of the condition block, so that it can be added again after the structured control flow instruction
+		std::vector<uint32_t> &words = _current_block_data->words;
+		assert(words.size() >= 4 && words[words.size() - 4] == ((4u << spv::WordCountShift) | spv::OpBranchConditional));
+		const spv::Id branch_operands[3] = { words[words.size() - 3], words[words.size() - 2], words[words.size() - 1] };
+		words.resize(words.size() - 4);
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
 		add_instruction_without_result(spv::OpSelectionMerge)
-			.add(merge_label.result)
+			.add(merge_label)
 			.add(selection_control & 0x3); // 'SelectionControl' happens to match the flags produced by the parser
 
 		// Append all blocks belonging to the branch
-		_current_block_data->instructions.push_back(branch_inst);
+		add_instruction_without_result(spv::OpBranchConditional)
+			.add(std::begin(branch_operands), std::end(branch_operands));
 		_current_block_data->append(_block_data[true_statement_block]);
 		_current_block_data->append(_block_data[false_statement_block]);
 
-		_current_block_data->instructions.push_back(merge_label);
+		spirv_instruction(*_current_block_data, spv::OpLabel, 0, merge_label);
 	}
 	id   emit_phi(const location &loc, id, id condition_block, id true_value, id true_statement_block, id false_value, id false_statement_block, const type &type) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		const spv::Id merge_label = _current_block_data->pop_label();
 
 		// Add previous block containing the condition value first
 		_current_block_data->append(_block_data[condition_block]);
@@ -2112,12 +2866,12 @@ private:
 		if (false_statement_block != condition_block)
 			_current_block_data->append(_block_data[false_statement_block]);
 
-		_current_block_data->instructions.push_back(merge_label);
+		spirv_instruction(*_current_block_data, spv::OpLabel, 0, merge_label);
 
 		add_location(loc, *_current_block_data);
 
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpPhi
-		spirv_instruction &inst = add_instruction(spv::OpPhi, convert_type(type))
+		spirv_instruction inst = add_instruction(spv::OpPhi, convert_type(type))
 			.add(true_value) // Variable 0
 			.add(true_statement_block) // Parent 0
 			.add(false_value) // Variable 1
@@ -2127,27 +2881,26 @@ private:
 	}
 	void emit_loop(const location &loc, id, id prev_block, id header_block, id condition_block, id loop_block, id continue_block, unsigned int loop_control) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		const spv::Id merge_label = _current_block_data->pop_label();
 
 		// Add previous block first
 		_current_block_data->append(_block_data[prev_block]);
 
 		// Fill header block
-		assert(_block_data[header_block].instructions.size() == 2);
-		_current_block_data->instructions.push_back(_block_data[header_block].instructions[0]);
-		assert(_current_block_data->instructions.back().op == spv::OpLabel);
+		const std::vector<uint32_t> &header_words = _block_data[header_block].words;
+		assert(header_words.size() == 4);
+		assert(header_words[0] == ((2u << spv::WordCountShift) | spv::OpLabel));
+		_current_block_data->words.insert(_current_block_data->words.end(), header_words.begin(), header_words.begin() + 2);
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
 		add_instruction_without_result(spv::OpLoopMerge)
-			.add(merge_label.result)
+			.add(merge_label)
 			.add(continue_block)
 			.add(loop_control & 0x3); // 'LoopControl' happens to match the flags produced by the parser
 
-		_current_block_data->instructions.push_back(_block_data[header_block].instructions[1]);
-		assert(_current_block_data->instructions.back().op == spv::OpBranch);
+		assert(header_words[2] == ((2u << spv::WordCountShift) | spv::OpBranch));
+		_current_block_data->words.insert(_current_block_data->words.end(), header_words.begin() + 2, header_words.end());
 
 		// Add condition block if it exists
 		if (condition_block != 0)
@@ -2157,38 +2910,38 @@ private:
 		_current_block_data->append(_block_data[loop_block]);
 		_current_block_data->append(_block_data[continue_block]);
 
-		_current_block_data->instructions.push_back(merge_label);
+		spirv_instruction(*_current_block_data, spv::OpLabel, 0, merge_label);
 	}
 	void emit_switch(const location &loc, id, id selector_block, id default_label, id default_block, const std::vector<id> &case_literal_and_labels, const std::vector<id> &case_blocks, unsigned int selection_control) override
 	{
 		assert(case_blocks.size() == case_literal_and_labels.size() / 2);
 
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		const spv::Id merge_label = _current_block_data->pop_label();
 
 		// Add previous block containing the selector value first
 		_current_block_data->append(_block_data[selector_block]);
 
-		spirv_instruction switch_inst = _current_block_data->instructions.back();
-		assert(switch_inst.op == spv::OpSwitch);
-		_current_block_data->instructions.pop_back();
+		// Remove the switch instruction at the end of the selector block, so that it can be added again after the structured control flow instruction
+		std::vector<uint32_t> &words = _current_block_data->words;
+		assert(words.size() >= 3 && words[words.size() - 3] == ((3u << spv::WordCountShift) | spv::OpSwitch));
+		const spv::Id selector_value = words[words.size() - 2];
+		words.resize(words.size() - 3);
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
 		add_instruction_without_result(spv::OpSelectionMerge)
-			.add(merge_label.result)
+			.add(merge_label)
 			.add(selection_control & 0x3); // 'SelectionControl' happens to match the flags produced by the parser
 
 		// Update switch instruction to contain all case labels
-		switch_inst.operands[1] = default_label;
-		switch_inst.add(case_literal_and_labels.begin(), case_literal_and_labels.end());
+		add_instruction_without_result(spv::OpSwitch)
+			.add(selector_value)
+			.add(default_label)
+			.add(case_literal_and_labels.begin(), case_literal_and_labels.end());
 
 		// Append all blocks belonging to the switch
-		_current_block_data->instructions.push_back(switch_inst);
-
 		std::vector<id> blocks = case_blocks;
-		if (default_label != merge_label.result)
+		if (default_label != merge_label)
 			blocks.push_back(default_block);
 		// Eliminate duplicates (because of multiple case labels pointing to the same block)
 		std::sort(blocks.begin(), blocks.end());
@@ -2196,7 +2949,7 @@ private:
 		for (const id case_block : blocks)
 			_current_block_data->append(_block_data[case_block]);
 
-		_current_block_data->instructions.push_back(merge_label);
+		spirv_instruction(*_current_block_data, spv::OpLabel, 0, merge_label);
 	}
 
 	bool is_in_function() const override { return _current_function != nullptr; }
@@ -2217,8 +2970,7 @@ private:
 
 		set_block(id);
 
-		add_instruction_without_result(spv::OpLabel)
-			.result = id;
+		spirv_instruction(*_current_block_data, spv::OpLabel, 0, id);
 	}
 	id   leave_block_and_kill() override
 	{
@@ -2299,16 +3051,24 @@ private:
 	{
 		assert(is_in_function()); // Can only leave if there was a function to begin with
 
-		_current_function->definition = _block_data[_last_block];
+		// The block data of the last block is not referenced anymore after this, so can move it into the function
+		_current_function->definition = std::move(_block_data[_last_block]);
 
 		// Append function end instruction
 		add_instruction_without_result(spv::OpFunctionEnd, _current_function->definition);
 
+		if (is_optimizing())
+			promote_local_variables(*_current_function);
+
+		_current_function->globals_end = current_global_offsets();
+
 		_current_function = nullptr;
 	}
 };
 
-codegen *reshadefx::create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y)
+codegen *reshadefx::create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y, bool optimize)
 {
+	if (optimize)
+		return new codegen_optimizer<codegen_spirv>(vulkan_semantics, debug_info, uniforms_to_spec_constants, enable_16bit_types, flip_vert_y);
 	return new codegen_spirv(vulkan_semantics, debug_info, uniforms_to_spec_constants, enable_16bit_types, flip_vert_y);
 }
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstring> // std::memcpy
+#include <cstdint>
+
+namespace reshadefx
+{
+	/// <summary>
+	/// A 128-bit hash value.
+	/// </summary>
+	struct hash128
+	{
+		uint64_t low = 0;
+		uint64_t high = 0;
+
+		bool operator==(const hash128 &other) const { return low == other.low && high == other.high; }
+		bool operator!=(const hash128 &other) const { return low != other.low || high != other.high; }
+
+		/// <summary>
+		/// Converts the hash value into a string of 32 hexadecimal digits.
+		/// </summary>
+		std::string to_string() const
+		{
+			std::string result(32, '0');
+			for (size_t i = 0; i < 32; ++i)
+			{
+				const unsigned int digit = static_cast<unsigned int>(((i < 16 ? high : low) >> (60 - 4 * (i % 16))) & 0xF);
+				result[i] = static_cast<char>(digit < 10 ? '0' + digit : 'a' + digit - 10);
+			}
+			return result;
+		}
+	};
+
+	/// <summary>
+	/// Computes a 128-bit hash of data that is passed in incrementally, so that it can be fed as it is produced, without having to keep or re-read all of it.
+	/// The result only depends on the concatenated bytes (not on how they were split up between calls) and is stable across builds and platforms, so it is suitable for persistent cache keys.
+	/// This is the 128-bit variant of MurmurHash3 (x64 version), which was placed in the public domain by its author Austin Appleby.
+	/// </summary>
+	class hasher
+	{
+	public:
+		explicit hasher(uint64_t seed = 0) : _h1(seed), _h2(seed) {}
+
+		/// <summary>
+		/// Appends the specified bytes to the hashed data.
+		/// </summary>
+		void update(const void *data, size_t size)
+		{
+			auto bytes = static_cast<const unsigned char *>(data);
+			_total_size += size;
+
+			// Complete a partial block left over from the previous call first
+			if (_buffer_size != 0)
+			{
+				const size_t count = size < (16 - _buffer_size) ? size : (16 - _buffer_size);
+				std::memcpy(_buffer + _buffer_size, bytes, count);
+				_buffer_size += count;
+				bytes += count;
+				size -= count;
+
+				if (_buffer_size < 16)
+					return;
+
+				process_block(_buffer);
+				_buffer_size = 0;
+			}
+
+			for (; size >= 16; bytes += 16, size -= 16)
+				process_block(bytes);
+
+			if (size != 0)
+			{
+				std::memcpy(_buffer, bytes, size);
+				_buffer_size = size;
+			}
+		}
+		void update(std::string_view data)
+		{
+			update(data.data(), data.size());
+		}
+
+		/// <summary>
+		/// Computes the hash of all data passed in so far. More data may still be appended afterwards.
+		/// </summary>
+		hash128 finalize() const
+		{
+			uint64_t h1 = _h1, h2 = _h2;
+			uint64_t k1 = 0, k2 = 0;
+
+			switch (_buffer_size)
+			{
+			case 15: k2 ^= static_cast<uint64_t>(_buffer[14]) << 48; [[fallthrough]];
+			case 14: k2 ^= static_cast<uint64_t>(_buffer[13]) << 40; [[fallthrough]];
+			case 13: k2 ^= static_cast<uint64_t>(_buffer[12]) << 32; [[fallthrough]];
+			case 12: k2 ^= static_cast<uint64_t>(_buffer[11]) << 24; [[fallthrough]];
+			case 11: k2 ^= static_cast<uint64_t>(_buffer[10]) << 16; [[fallthrough]];
+			case 10: k2 ^= static_cast<uint64_t>(_buffer[ 9]) <<  8; [[fallthrough]];
+			case  9: k2 ^= static_cast<uint64_t>(_buffer[ 8]);
+				k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+				[[fallthrough]];
+			case  8: k1 ^= static_cast<uint64_t>(_buffer[ 7]) << 56; [[fallthrough]];
+			case  7: k1 ^= static_cast<uint64_t>(_buffer[ 6]) << 48; [[fallthrough]];
+			case  6: k1 ^= static_cast<uint64_t>(_buffer[ 5]) << 40; [[fallthrough]];
+			case  5: k1 ^= static_cast<uint64_t>(_buffer[ 4]) << 32; [[fallthrough]];
+			case  4: k1 ^= static_cast<uint64_t>(_buffer[ 3]) << 24; [[fallthrough]];
+			case  3: k1 ^= static_cast<uint64_t>(_buffer[ 2]) << 16; [[fallthrough]];
+			case  2: k1 ^= static_cast<uint64_t>(_buffer[ 1]) <<  8; [[fallthrough]];
+			case  1: k1 ^= static_cast<uint64_t>(_buffer[ 0]);
+				k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+				break;
+			}
+
+			h1 ^= _total_size;
+			h2 ^= _total_size;
+
+			h1 += h2;
+			h2 += h1;
+
+			h1 = fmix(h1);
+			h2 = fmix(h2);
+
+			h1 += h2;
+			h2 += h1;
+
+			return { h1, h2 };
+		}
+
+	private:
+		static constexpr uint64_t c1 = 0x87c37b91114253d5ull;
+		static constexpr uint64_t c2 = 0x4cf5ad432745937full;
+
+		static uint64_t rotl(uint64_t x, int r)
+		{
+			return (x << r) | (x >> (64 - r));
+		}
+		static uint64_t fmix(uint64_t k)
+		{
+			k ^= k >> 33;
+			k *= 0xff51afd7ed558ccdull;
+			k ^= k >> 33;
+			k *= 0xc4ceb9fe1a85ec53ull;
+			k ^= k >> 33;
+			return k;
+		}
+
+		void process_block(const unsigned char *block)
+		{
+			// Blocks are read as little-endian, which matches the memory layout on all platforms this runs on
+			uint64_t k1, k2;
+			std::memcpy(&k1, block, 8);
+			std::memcpy(&k2, block + 8, 8);
+
+			k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; _h1 ^= k1;
+			_h1 = rotl(_h1, 27); _h1 += _h2; _h1 = _h1 * 5 + 0x52dce729;
+
+			k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; _h2 ^= k2;
+			_h2 = rotl(_h2, 31); _h2 += _h1; _h2 = _h2 * 5 + 0x38495ab5;
+		}
+
+		uint64_t _h1, _h2;
+		uint64_t _total_size = 0;
+		unsigned char _buffer[16];
+		size_t _buffer_size = 0;
+	};
+
+	/// <summary>
+	/// Computes the 128-bit hash of the specified <paramref name="data"/> in one go.
+	/// </summary>
+	inline hash128 hash(std::string_view data)
+	{
+		hasher hasher;
+		hasher.update(data);
+		return hasher.finalize();
+	}
+}
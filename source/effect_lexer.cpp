@@ -5,6 +5,7 @@
 
 #include "effect_lexer.hpp"
 #include <cassert>
+#include <iterator> // std::size
 #include <unordered_map> // Used for static lookup tables
 
 using namespace reshadefx;
@@ -198,7 +199,73 @@ static const std::unordered_map<tokenid, std::string> token_lookup = {
 	{ tokenid::sampler, "sampler" },
 	{ tokenid::storage, "storage" },
 };
-static const std::unordered_map<std::string, tokenid> keyword_lookup = {
+struct identifier_entry
+{
+	std::string_view name;
+	tokenid id = tokenid::unknown;
+};
+
+// Perfect hash table that is built at compile time from a fixed list of identifiers, so that a lookup needs to hash and compare the input characters only once
+// The identifiers are first distributed into buckets, and every bucket then uses its own seed that maps all identifiers in it to distinct slots ("hash and displace")
+// Searching for these seeds is too expensive to do in a constant expression (it exceeds the step limits of some compilers), so they were searched for offline and are passed in as literals
+// To regenerate them after changing an identifier list, place the largest buckets first and pick the smallest non-zero seed for each that only hits free slots (the static assertions below fail if the seeds do not fit the list)
+template <size_t num_entries, size_t num_buckets, size_t num_slots>
+class perfect_hash_table
+{
+	static_assert((num_buckets & (num_buckets - 1)) == 0 && (num_slots & (num_slots - 1)) == 0, "table sizes have to be a power of two");
+
+public:
+	constexpr perfect_hash_table(const identifier_entry (&entries)[num_entries], const uint32_t (&seeds)[num_buckets]) : _seeds(), _slots()
+	{
+		for (size_t i = 0; i < num_buckets; ++i)
+			_seeds[i] = seeds[i];
+
+		for (size_t i = 0; i < num_entries; ++i)
+		{
+			const size_t slot = hash(entries[i].name, _seeds[hash(entries[i].name, 0) & (num_buckets - 1)]) & (num_slots - 1);
+			if (!_slots[slot].name.empty())
+				return; // Collision, '_valid' stays false and the static assertion below catches this
+
+			_slots[slot] = entries[i];
+
+			if (i == 0 || entries[i].name.size() < _min_length)
+				_min_length = entries[i].name.size();
+			if (i == 0 || entries[i].name.size() > _max_length)
+				_max_length = entries[i].name.size();
+		}
+
+		_valid = true;
+	}
+
+	constexpr bool valid() const { return _valid; }
+
+	tokenid find(std::string_view name) const
+	{
+		if (name.size() < _min_length || name.size() > _max_length)
+			return tokenid::unknown;
+
+		const identifier_entry &entry = _slots[hash(name, _seeds[hash(name, 0) & (num_buckets - 1)]) & (num_slots - 1)];
+		return entry.name == name ? entry.id : tokenid::unknown;
+	}
+
+private:
+	static constexpr uint32_t hash(std::string_view name, uint32_t seed)
+	{
+		// FNV-1a over the length and characters, with the seed mixed into the offset basis
+		uint32_t value = 2166136261u ^ (seed * 0x9E3779B9u);
+		value = (value ^ static_cast<uint32_t>(name.size())) * 16777619u;
+		for (const char c : name)
+			value = (value ^ static_cast<uint8_t>(c)) * 16777619u;
+		return value ^ (value >> 16);
+	}
+
+	bool _valid = false;
+	size_t _min_length = 0, _max_length = 0;
+	uint32_t _seeds[num_buckets];
+	identifier_entry _slots[num_slots];
+};
+
+static constexpr identifier_entry keyword_list[] = {
 	{ "asm", tokenid::reserved },
 	{ "asm_fragment", tokenid::reserved },
 	{ "auto", tokenid::reserved },
@@ -432,7 +499,7 @@ static const std::unordered_map<std::string, tokenid> keyword_lookup = {
 	{ "volatile", tokenid::volatile_ },
 	{ "while", tokenid::while_ }
 };
-static const std::unordered_map<std::string, tokenid> pp_directive_lookup = {
+static constexpr identifier_entry pp_directive_list[] = {
 	{ "define", tokenid::hash_def },
 	{ "undef", tokenid::hash_undef },
 	{ "if", tokenid::hash_if },
@@ -447,6 +514,25 @@ static const std::unordered_map<std::string, tokenid> pp_directive_lookup = {
 	{ "include", tokenid::hash_include },
 };
 
+static constexpr uint32_t keyword_seeds[128] = {
+	1, 1, 0, 1, 1, 0, 1, 2, 2, 1, 1, 0, 1, 0, 2, 1,
+	3, 2, 1, 1, 1, 1, 1, 3, 1, 1, 0, 1, 0, 0, 1, 1,
+	1, 2, 1, 3, 1, 1, 1, 1, 1, 1, 0, 1, 2, 1, 2, 5,
+	1, 1, 1, 1, 1, 0, 2, 1, 2, 0, 2, 1, 0, 2, 1, 3,
+	0, 1, 0, 1, 4, 1, 2, 0, 2, 0, 2, 0, 3, 3, 0, 2,
+	4, 1, 1, 1, 1, 0, 0, 2, 2, 5, 1, 0, 1, 2, 2, 1,
+	1, 2, 1, 1, 0, 1, 0, 3, 1, 1, 6, 1, 1, 1, 1, 1,
+	1, 3, 0, 1, 2, 1, 1, 2, 5, 1, 3, 2, 1, 1, 0, 2,
+};
+static constexpr uint32_t pp_directive_seeds[4] = {
+	2, 1, 2, 8,
+};
+
+static constexpr perfect_hash_table<std::size(keyword_list), 128, 512> keyword_lookup(keyword_list, keyword_seeds);
+static_assert(keyword_lookup.valid(), "perfect hash table seeds do not match keyword list");
+static constexpr perfect_hash_table<std::size(pp_directive_list), 4, 32> pp_directive_lookup(pp_directive_list, pp_directive_seeds);
+static_assert(pp_directive_lookup.valid(), "perfect hash table seeds do not match preprocessor directive list");
+
 static inline bool is_octal_digit(char c)
 {
 	return static_cast<unsigned>(c - '0') < 8;
@@ -514,7 +600,7 @@ next_token:
 	tok.offset = input_offset();
 	tok.length = 1;
 	tok.literal_as_double = 0;
-	tok.literal_as_string.clear();
+	tok.literal_as_string = {};
 
 	assert(_cur <= _end);
 
@@ -804,14 +890,14 @@ void reshadefx::lexer::parse_identifier(token &tok) const
 	tok.id = tokenid::identifier;
 	tok.offset = input_offset();
 	tok.length = end - begin;
-	tok.literal_as_string.assign(begin, end);
+	tok.literal_as_string = std::string_view(begin, end - begin);
 
 	if (_ignore_keywords)
 		return;
 
-	if (const auto it = keyword_lookup.find(tok.literal_as_string);
-		it != keyword_lookup.end())
-		tok.id = it->second;
+	if (const tokenid keyword = keyword_lookup.find(tok.literal_as_string);
+		keyword != tokenid::unknown)
+		tok.id = keyword;
 }
 bool reshadefx::lexer::parse_pp_directive(token &tok)
 {
@@ -819,10 +905,10 @@ bool reshadefx::lexer::parse_pp_directive(token &tok)
 	skip_space(); // Skip any space between the '#' and directive
 	parse_identifier(tok);
 
-	if (const auto it = pp_directive_lookup.find(tok.literal_as_string);
-		it != pp_directive_lookup.end())
+	if (const tokenid directive = pp_directive_lookup.find(tok.literal_as_string);
+		directive != tokenid::unknown)
 	{
-		tok.id = it->second;
+		tok.id = directive;
 		return true;
 	}
 	else if (!_ignore_line_directives && tok.literal_as_string == "line") // The #line directive needs special handling
@@ -846,7 +932,9 @@ bool reshadefx::lexer::parse_pp_directive(token &tok)
 			token temptok;
 			parse_string_literal(temptok, false);
 
-			_cur_location.source = std::move(temptok.literal_as_string);
+			// File names can only be tracked when there is a table to add them to
+			if (_sources != nullptr)
+				_cur_location.source = _sources->insert(temptok.literal_as_string);
 		}
 
 		// Do not return the #line directive as token to the caller
@@ -860,11 +948,20 @@ bool reshadefx::lexer::parse_pp_directive(token &tok)
 void reshadefx::lexer::parse_string_literal(token &tok, bool escape)
 {
 	auto *const begin = _cur, *end = begin + 1; // Skip first quote character right away
+	const std::string::value_type *value_end = nullptr;
+
+	// The value references the input characters directly, until it differs from them (because of escape sequences, ...), at which point it is copied into separate storage
+	std::string *value = nullptr;
+	const auto copy_value = [&]() {
+		if (value == nullptr)
+			value = &_string_literals.emplace_front(begin + 1, end);
+	};
 
 	for (auto c = *end; c != '"'; c = *++end)
 	{
 		if (c == '\n' || end >= _end)
 		{
+			value_end = end;
 			// Line feed reached, the string literal is done (technically this should be an error, but the lexer does not report errors, so ignore it)
 			end--;
 			if (end[0] == '\r') end--;
@@ -873,6 +970,7 @@ void reshadefx::lexer::parse_string_literal(token &tok, bool escape)
 
 		if (c == '\r')
 		{
+			copy_value();
 			// Silently ignore carriage return characters
 			continue;
 		}
@@ -880,6 +978,7 @@ void reshadefx::lexer::parse_string_literal(token &tok, bool escape)
 		if (unsigned int n = (end[1] == '\r' && end + 2 < _end) ? 2 : 1;
 			c == '\\' && end[n] == '\n')
 		{
+			copy_value();
 			// Escape character found at end of line, the string literal continues on to the next line
 			end += n;
 			_cur_location.line++;
@@ -889,6 +988,8 @@ void reshadefx::lexer::parse_string_literal(token &tok, bool escape)
 		// Handle escape sequences
 		if (c == '\\' && escape)
 		{
+			copy_value();
+
 			unsigned int n = 0;
 
 			// Any character following the '\' is not parsed as usual, so increment pointer here (this makes sure '\"' does not abort the outer loop as well)
@@ -951,9 +1052,15 @@ void reshadefx::lexer::parse_string_literal(token &tok, bool escape)
 			}
 		}
 
-		tok.literal_as_string += c;
+		if (value != nullptr)
+			value->push_back(c);
 	}
 
+	if (value != nullptr)
+		tok.literal_as_string = *value;
+	else
+		tok.literal_as_string = std::string_view(begin + 1, (value_end != nullptr ? value_end : end) - (begin + 1));
+
 	tok.id = tokenid::string_literal;
 	tok.length = end - begin + 1;
 }
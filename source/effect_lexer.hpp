@@ -6,6 +6,8 @@
 #pragma once
 
 #include "effect_token.hpp"
+#include <forward_list>
+#include <cassert>
 
 namespace reshadefx
 {
@@ -15,6 +17,9 @@ namespace reshadefx
 	class lexer
 	{
 	public:
+		/// <summary>
+		/// Constructs a lexical analyzer which takes ownership of the <paramref name="input"/> string.
+		/// </summary>
 		explicit lexer(
 			std::string input,
 			bool ignore_comments = true,
@@ -23,9 +28,12 @@ namespace reshadefx
 			bool ignore_line_directives = false,
 			bool ignore_keywords = false,
 			bool escape_string_literals = true,
-			const location &start_location = location()) :
-			_input(std::move(input)),
+			const location &start_location = location(),
+			source_table *sources = nullptr) :
+			_input_storage(std::move(input)),
+			_input(_input_storage),
 			_cur_location(start_location),
+			_sources(sources),
 			_ignore_comments(ignore_comments),
 			_ignore_whitespace(ignore_whitespace),
 			_ignore_pp_directives(ignore_pp_directives),
@@ -36,12 +44,44 @@ namespace reshadefx
 			_cur = _input.data();
 			_end = _cur + _input.size();
 		}
+		/// <summary>
+		/// Constructs a lexical analyzer which operates on a borrowed <paramref name="input"/> buffer without copying it.
+		/// The buffer has to be null-terminated and stay alive for as long as this lexer and the tokens returned by it are used.
+		/// </summary>
+		explicit lexer(
+			std::string_view input,
+			bool ignore_comments = true,
+			bool ignore_whitespace = true,
+			bool ignore_pp_directives = true,
+			bool ignore_line_directives = false,
+			bool ignore_keywords = false,
+			bool escape_string_literals = true,
+			const location &start_location = location(),
+			source_table *sources = nullptr) :
+			_input(input),
+			_cur_location(start_location),
+			_sources(sources),
+			_ignore_comments(ignore_comments),
+			_ignore_whitespace(ignore_whitespace),
+			_ignore_pp_directives(ignore_pp_directives),
+			_ignore_line_directives(ignore_line_directives),
+			_ignore_keywords(ignore_keywords),
+			_escape_string_literals(escape_string_literals)
+		{
+			assert(_input.data() != nullptr && _input.data()[_input.size()] == '\0');
+
+			_cur = _input.data();
+			_end = _cur + _input.size();
+		}
 
 		lexer(const lexer &lexer) { operator=(lexer); }
 		lexer &operator=(const lexer &lexer)
 		{
-			_input = lexer._input;
+			_input_storage = lexer._input_storage;
+			// Only point to the own copy of the input if the other lexer owned its input, otherwise keep borrowing the same buffer
+			_input = lexer._input.data() == lexer._input_storage.data() ? std::string_view(_input_storage) : lexer._input;
 			_cur_location = lexer._cur_location;
+			_sources = lexer._sources;
 			reset_to_offset(lexer._cur - lexer._input.data());
 			_end = _input.data() + _input.size();
 			_ignore_comments = lexer._ignore_comments;
@@ -62,8 +102,8 @@ namespace reshadefx
 		/// <summary>
 		/// Gets the input string this lexical analyzer works on.
 		/// </summary>
-		/// <returns>Constant reference to the input string.</returns>
-		const std::string &input_string() const { return _input; }
+		/// <returns>View of the input string.</returns>
+		std::string_view input_string() const { return _input; }
 
 		/// <summary>
 		/// Performs lexical analysis on the input string and return the next token in sequence.
@@ -98,8 +138,13 @@ namespace reshadefx
 		void parse_string_literal(token &tok, bool escape);
 		void parse_numeric_literal(token &tok) const;
 
-		std::string _input;
+		std::string _input_storage;
+		std::string_view _input;
+		// Storage for string literals whose value differs from the input characters (e.g. because of escape sequences)
+		// This is a list, since it does not allocate anything until the first string is added, which keeps constructing a lexer cheap
+		std::forward_list<std::string> _string_literals;
 		location _cur_location;
+		source_table *_sources;
 		const std::string::value_type *_cur, *_end;
 		bool _ignore_comments;
 		bool _ignore_whitespace;
@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "effect_module.hpp"
+#include <cstring> // memcpy
+#include <type_traits>
+
+// Identifies the binary format, which has to be incremented whenever the layout of any of the serialized structures changes
+static constexpr uint32_t s_module_magic = 0x4d584652; // "RFXM"
+static constexpr uint32_t s_module_version = 1;
+
+namespace
+{
+	template <typename archive>
+	void transfer(archive &ar, reshadefx::type &type)
+	{
+		ar(type.base);
+		ar(type.rows);
+		ar(type.cols);
+		ar(type.qualifiers);
+		ar(type.array_length);
+		ar(type.definition);
+	}
+	template <typename archive>
+	void transfer(archive &ar, reshadefx::constant &constant)
+	{
+		ar(constant.as_uint);
+		ar(constant.string_data);
+		ar(constant.array_data);
+	}
+	template <typename archive>
+	void transfer(archive &ar, reshadefx::annotation &annotation)
+	{
+		transfer(ar, annotation.type);
+		ar(annotation.name);
+		transfer(ar, annotation.value);
+	}
+	template <typename archive>
+	void transfer(archive &ar, reshadefx::entry_point &entry_point)
+	{
+		ar(entry_point.name);
+		ar(entry_point.type);
+		ar(entry_point.hlsl);
+		ar(entry_point.spirv);
+	}
+	template <typename archive>
+	void transfer(archive &ar, reshadefx::texture_info &info)
+	{
+		ar(info.id);
+		ar(info.binding);
+		ar(info.name);
+		ar(info.semantic);
+		ar(info.unique_name);
+		ar(info.annotations);
+		ar(info.width);
+		ar(info.height);
+		ar(info.levels);
+		ar(info.format);
+		ar(info.render_target);
+		ar(info.storage_access);
+	}
+	template <typename archive>
+	void transfer(archive &ar, reshadefx::sampler_info &info)
+	{
+		ar(info.id);
+		ar(info.binding);
+		ar(info.texture_binding);
+		ar(info.name);
+		ar(info.unique_name);
+		ar(info.texture_name);
+		ar(info.annotations);
+		ar(info.filter);
+		ar(info.address_u);
+		ar(info.address_v);
+		ar(info.address_w);
+		ar(info.min_lod);
+		ar(info.max_lod);
+		ar(info.lod_bias);
+		ar(info.srgb);
+	}
+	template <typename archive>
+	void transfer(archive &ar, reshadefx::storage_info &info)
+	{
+		ar(info.id);
+		ar(info.binding);
+		ar(info.name);
+		ar(info.unique_name);
+		ar(info.texture_name);
+		ar(info.format);
+		ar(info.level);
+	}
+	template <typename archive>
+	void transfer(archive &ar, reshadefx::uniform_info &info)
+	{
+		ar(info.name);
+		transfer(ar, info.type);
+		ar(info.size);
+		ar(info.offset);
+		ar(info.annotations);
+		ar(info.has_initializer_value);
+		transfer(ar, info.initializer_value);
+	}
+	template <typename archive>
+	void transfer(archive &ar, reshadefx::pass_info &info)
+	{
+		ar(info.name);
+		for (std::string &render_target_name : info.render_target_names)
+			ar(render_target_name);
+		ar(info.vs_entry_point);
+		ar(info.ps_entry_point);
+		ar(info.cs_entry_point);
+		ar(info.generate_mipmaps);
+		ar(info.clear_render_targets);
+		ar(info.srgb_write_enable);
+		ar(info.blend_enable);
+		ar(info.stencil_enable);
+		ar(info.color_write_mask);
+		ar(info.stencil_read_mask);
+		ar(info.stencil_write_mask);
+		ar(info.blend_op);
+		ar(info.blend_op_alpha);
+		ar(info.src_blend);
+		ar(info.dest_blend);
+		ar(info.src_blend_alpha);
+		ar(info.dest_blend_alpha);
+		ar(info.stencil_comparison_func);
+		ar(info.stencil_reference_value);
+		ar(info.stencil_op_pass);
+		ar(info.stencil_op_fail);
+		ar(info.stencil_op_depth_fail);
+		ar(info.num_vertices);
+		ar(info.topology);
+		ar(info.viewport_width);
+		ar(info.viewport_height);
+		ar(info.viewport_dispatch_z);
+		ar(info.samplers);
+		ar(info.storages);
+	}
+	template <typename archive>
+	void transfer(archive &ar, reshadefx::technique_info &info)
+	{
+		ar(info.name);
+		ar(info.passes);
+		ar(info.annotations);
+	}
+	template <typename archive>
+	void transfer(archive &ar, reshadefx::module &module)
+	{
+		ar(module.hlsl);
+		ar(module.spirv);
+		ar(module.entry_points);
+		ar(module.textures);
+		ar(module.samplers);
+		ar(module.storages);
+		ar(module.uniforms);
+		ar(module.spec_constants);
+		ar(module.techniques);
+		ar(module.total_uniform_size);
+		ar(module.num_texture_bindings);
+		ar(module.num_sampler_bindings);
+		ar(module.num_storage_bindings);
+	}
+
+	class module_writer
+	{
+	public:
+		explicit module_writer(std::string &data) : _data(data) {}
+
+		template <typename T>
+		std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>> operator()(const T &value)
+		{
+			_data.append(reinterpret_cast<const char *>(&value), sizeof(value));
+		}
+		template <typename T, size_t N>
+		void operator()(const T (&values)[N])
+		{
+			for (const T &value : values)
+				operator()(value);
+		}
+		void operator()(const std::string &value)
+		{
+			operator()(static_cast<uint32_t>(value.size()));
+			_data.append(value);
+		}
+		void operator()(const std::vector<uint32_t> &values)
+		{
+			operator()(static_cast<uint32_t>(values.size()));
+			_data.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(uint32_t));
+		}
+		template <typename T>
+		std::enable_if_t<!std::is_arithmetic_v<T>> operator()(const std::vector<T> &values)
+		{
+			operator()(static_cast<uint32_t>(values.size()));
+			for (const T &value : values)
+				transfer(*this, const_cast<T &>(value)); // The writer never modifies the values passed to it
+		}
+
+		bool failed() const { return false; }
+
+	private:
+		std::string &_data;
+	};
+
+	class module_reader
+	{
+	public:
+		module_reader(const void *data, size_t size) : _data(static_cast<const char *>(data)), _size(size) {}
+
+		template <typename T>
+		std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>> operator()(T &value)
+		{
+			if (const char *const source = consume(sizeof(value)))
+				std::memcpy(&value, source, sizeof(value));
+			else
+				value = T();
+		}
+		template <typename T, size_t N>
+		void operator()(T (&values)[N])
+		{
+			for (T &value : values)
+				operator()(value);
+		}
+		void operator()(std::string &value)
+		{
+			const uint32_t size = read_count(1);
+			if (const char *const source = consume(size))
+				value.assign(source, size);
+			else
+				value.clear();
+		}
+		void operator()(std::vector<uint32_t> &values)
+		{
+			const uint32_t size = read_count(sizeof(uint32_t));
+			values.resize(size);
+			if (const char *const source = consume(size * sizeof(uint32_t)); source != nullptr && size != 0)
+				std::memcpy(values.data(), source, size * sizeof(uint32_t));
+		}
+		template <typename T>
+		std::enable_if_t<!std::is_arithmetic_v<T>> operator()(std::vector<T> &values)
+		{
+			values.resize(read_count(1));
+			for (T &value : values)
+				transfer(*this, value);
+		}
+
+		bool failed() const { return _failed; }
+
+	private:
+		const char *consume(size_t size)
+		{
+			if (_failed || size > _size - _offset)
+			{
+				_failed = true;
+				return nullptr;
+			}
+
+			const char *const result = _data + _offset;
+			_offset += size;
+			return result;
+		}
+
+		// Reads an element count and validates it against the remaining data, to avoid huge allocations for corrupted input
+		uint32_t read_count(size_t min_element_size)
+		{
+			uint32_t count = 0;
+			operator()(count);
+			if (count > (_size - _offset) / min_element_size)
+				_failed = true;
+			return _failed ? 0 : count;
+		}
+
+		const char *const _data;
+		const size_t _size;
+		size_t _offset = 0;
+		bool _failed = false;
+	};
+}
+
+void reshadefx::serialize_module(const module &module, std::string &data)
+{
+	module_writer writer(data);
+	writer(s_module_magic);
+	writer(s_module_version);
+	transfer(writer, const_cast<reshadefx::module &>(module)); // The writer never modifies the module
+}
+
+bool reshadefx::deserialize_module(const void *data, size_t size, module &module)
+{
+	module_reader reader(data, size);
+
+	uint32_t magic = 0, version = 0;
+	reader(magic);
+	reader(version);
+	if (reader.failed() || magic != s_module_magic || version != s_module_version)
+		return false;
+
+	transfer(reader, module);
+
+	if (reader.failed())
+	{
+		module = {};
+		return false;
+	}
+
+	return true;
+}
@@ -248,6 +248,12 @@ namespace reshadefx
 	{
 		std::string name;
 		shader_type type;
+
+		/// <summary>
+		/// Code containing only this entry point and the functions it references (empty unless the module was written with <c>split_entry_points</c> enabled).
+		/// </summary>
+		std::string hlsl;
+		std::vector<uint32_t> spirv;
 	};
 
 	/// <summary>
@@ -263,6 +269,7 @@ namespace reshadefx
 		std::vector<struct_member_info> parameter_list;
 		std::unordered_set<uint32_t> referenced_samplers;
 		std::unordered_set<uint32_t> referenced_storages;
+		std::unordered_set<uint32_t> referenced_functions;
 	};
 
 	/// <summary>
@@ -333,4 +340,20 @@ namespace reshadefx
 		uint32_t num_sampler_bindings = 0;
 		uint32_t num_storage_bindings = 0;
 	};
+
+	/// <summary>
+	/// Appends a compact binary representation of a module to <paramref name="data"/>, which can be turned back into a module with <see cref="deserialize_module"/>.
+	/// </summary>
+	/// <param name="module">Module to serialize.</param>
+	/// <param name="data">Target to append the serialized data to.</param>
+	void serialize_module(const module &module, std::string &data);
+	/// <summary>
+	/// Reconstructs a module from the binary representation written by <see cref="serialize_module"/>.
+	/// This reads directly from the specified memory (e.g. a file mapped into memory), without any intermediate copies.
+	/// </summary>
+	/// <param name="data">Pointer to the serialized data.</param>
+	/// <param name="size">Size of the serialized data in bytes.</param>
+	/// <param name="module">Target module to fill.</param>
+	/// <returns><see langword="true"/> if the data was valid and written with the same format version, <see langword="false"/> otherwise.</returns>
+	bool deserialize_module(const void *data, size_t size, module &module);
 }
@@ -23,10 +23,10 @@ namespace reshadefx
 		/// <summary>
 		/// Parses the provided input string.
 		/// </summary>
-		/// <param name="source">String to analyze.</param>
+		/// <param name="source">Null-terminated string to analyze. It is not copied, so it has to stay alive until this function returns.</param>
 		/// <param name="backend">Code generation implementation to use.</param>
 		/// <returns><see langword="true"/> if parsing was successfull, <see langword="false"/> otherwise.</returns>
-		bool parse(std::string source, class codegen *backend);
+		bool parse(std::string_view source, class codegen *backend);
 
 		/// <summary>
 		/// Gets the list of error messages.
@@ -51,7 +51,7 @@ namespace reshadefx
 		bool expect(char tok) { return expect(static_cast<tokenid>(tok)); }
 		bool expect(tokenid tokid);
 
-		bool accept_symbol(std::string &identifier, scoped_symbol &symbol);
+		bool accept_symbol(std::string &identifier, const scoped_symbol *&symbol);
 		bool accept_type_class(type &type);
 		bool accept_type_qualifiers(type &type);
 		bool accept_unary_op();
@@ -74,14 +74,24 @@ namespace reshadefx
 		bool parse_annotations(std::vector<annotation> &annotations);
 		bool parse_statement(bool scoped);
 		bool parse_statement_block(bool scoped);
+		bool parse_statement_unreachable();
+
+		size_t find_statement_end(size_t index) const;
+		bool find_constant_loop_iterations(type &counter_type, std::string &counter_name, std::vector<int> &counter_values, size_t &body_index) const;
 
 		codegen *_codegen = nullptr;
 		std::string _errors;
-		token _token, _token_next, _token_backup;
+		source_table _sources;
+		token _token, _token_next;
+		// The whole input is lexed in advance, so that backtracking only has to reset an index instead of lexing the same characters again
+		std::vector<compact_token> _tokens;
+		size_t _token_next_index = 0;
+		size_t _token_backup_index = 0;
+		// String literals may reference storage owned by the lexer, so keep it alive while parsing
 		std::unique_ptr<class lexer> _lexer;
-		size_t _lexer_backup_offset = 0;
 		std::vector<uint32_t> _loop_break_target_stack;
 		std::vector<uint32_t> _loop_continue_target_stack;
+		unsigned int _unrolled_loop_depth = 0;
 		reshadefx::function_info *_current_function = nullptr;
 	};
 }
@@ -17,7 +17,7 @@ reshadefx::parser::~parser()
 
 void reshadefx::parser::error(const location &location, unsigned int code, const std::string &message)
 {
-	_errors += location.source;
+	_errors += _sources[location.source];
 	_errors += '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": error";
 	_errors += (code == 0) ? ": " : " X" + std::to_string(code) + ": ";
 	_errors += message;
@@ -25,7 +25,7 @@ void reshadefx::parser::error(const location &location, unsigned int code, const
 }
 void reshadefx::parser::warning(const location &location, unsigned int code, const std::string &message)
 {
-	_errors += location.source;
+	_errors += _sources[location.source];
 	_errors += '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": warning";
 	_errors += (code == 0) ? ": " : " X" + std::to_string(code) + ": ";
 	_errors += message;
@@ -34,19 +34,23 @@ void reshadefx::parser::warning(const location &location, unsigned int code, con
 
 void reshadefx::parser::backup()
 {
-	_token_backup = _token_next;
-	_lexer_backup_offset = _lexer->input_offset();
+	_token_backup_index = _token_next_index;
 }
 void reshadefx::parser::restore()
 {
-	_lexer->reset_to_offset(_lexer_backup_offset);
-	_token_next = _token_backup; // Copy instead of move here, since restore may be called twice (from 'accept_type_class' and then again from 'parse_expression_unary')
+	// This may be called twice for the same backup (from 'accept_type_class' and then again from 'parse_expression_unary'), which is fine since the token array is not modified
+	_token_next_index = _token_backup_index;
+	_token_next = _tokens[_token_next_index].expand();
 }
 
 void reshadefx::parser::consume()
 {
 	_token = std::move(_token_next);
-	_token_next = _lexer->lex();
+
+	// The last token is always the EOF token, so stay on it once it was reached
+	if (_token_next_index + 1 < _tokens.size())
+		_token_next_index++;
+	_token_next = _tokens[_token_next_index].expand();
 }
 void reshadefx::parser::consume_until(tokenid tokid)
 {
@@ -77,7 +81,7 @@ bool reshadefx::parser::expect(tokenid tokid)
 	return true;
 }
 
-bool reshadefx::parser::accept_symbol(std::string &identifier, scoped_symbol &symbol)
+bool reshadefx::parser::accept_symbol(std::string &identifier, const scoped_symbol *&symbol)
 {
 	// Starting an identifier with '::' restricts the symbol search to the global namespace level
 	const bool exclusive = accept(tokenid::colon_colon);
@@ -90,14 +94,15 @@ bool reshadefx::parser::accept_symbol(std::string &identifier, scoped_symbol &sy
 		return false;
 	}
 
-	identifier = std::move(_token.literal_as_string);
+	identifier = _token.literal_as_string;
 
 	// Can concatenate multiple '::' to force symbol search for a specific namespace level
 	while (accept(tokenid::colon_colon))
 	{
 		if (!expect(tokenid::identifier))
 			return false;
-		identifier += "::" + std::move(_token.literal_as_string);
+		identifier += "::";
+		identifier += _token.literal_as_string;
 	}
 
 	// Figure out which scope to start searching in
@@ -105,7 +110,7 @@ bool reshadefx::parser::accept_symbol(std::string &identifier, scoped_symbol &sy
 	if (!exclusive) scope = current_scope();
 
 	// Lookup name in the symbol table
-	symbol = find_symbol(identifier, scope, exclusive);
+	symbol = &find_symbol(identifier, scope, exclusive);
 
 	return true;
 }
@@ -120,12 +125,12 @@ bool reshadefx::parser::accept_type_class(type &type)
 		backup(); // Need to restore if this identifier does not turn out to be a structure
 
 		std::string identifier;
-		scoped_symbol symbol;
+		const scoped_symbol *symbol = nullptr;
 		if (accept_symbol(identifier, symbol))
 		{
-			if (symbol.id && symbol.op == symbol_type::structure)
+			if (symbol->id && symbol->op == symbol_type::structure)
 			{
-				type.definition = symbol.id;
+				type.definition = symbol->id;
 				return true;
 			}
 		}
@@ -670,7 +675,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 	}
 	else if (accept(tokenid::string_literal))
 	{
-		std::string value = std::move(_token.literal_as_string);
+		std::string value(_token.literal_as_string);
 
 		// Multiple string literals in sequence are concatenated into a single string literal
 		while (accept(tokenid::string_literal))
@@ -785,7 +790,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 	else
 	{
 		std::string identifier;
-		scoped_symbol symbol;
+		const scoped_symbol *symbol = nullptr;
 		if (!accept_symbol(identifier, symbol))
 			return false;
 
@@ -793,7 +798,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 		if (accept('('))
 		{
 			// Can only call symbols that are functions, but do not abort yet if no symbol was found since the identifier may reference an intrinsic
-			if (symbol.id && symbol.op != symbol_type::function)
+			if (symbol->id && symbol->op != symbol_type::function)
 				return error(location, 3005, "identifier '" + identifier + "' represents a variable, not a function"), false;
 
 			// Parse entire argument expression list
@@ -821,9 +826,10 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 				return error(location, 3005, "invalid function call outside of a function"), false;
 
 			// Try to resolve the call by searching through both function symbols and intrinsics
-			bool undeclared = !symbol.id, ambiguous = false;
+			struct symbol callee;
+			bool undeclared = !symbol->id, ambiguous = false;
 
-			if (!resolve_function_call(identifier, arguments, symbol.scope, symbol, ambiguous))
+			if (!resolve_function_call(identifier, arguments, symbol->scope, callee, ambiguous))
 			{
 				if (undeclared)
 					error(location, 3004, "undeclared identifier or no matching intrinsic overload for '" + identifier + '\'');
@@ -834,14 +840,14 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 				return false;
 			}
 
-			assert(symbol.function != nullptr);
+			assert(callee.function != nullptr);
 
 			std::vector<expression> parameters(arguments.size());
 
 			// We need to allocate some temporary variables to pass in and load results from pointer parameters
 			for (size_t i = 0; i < arguments.size(); ++i)
 			{
-				const auto &param_type = symbol.function->parameter_list[i].type;
+				const auto &param_type = callee.function->parameter_list[i].type;
 
 				if (param_type.has(type::q_out) && (arguments[i].type.has(type::q_const) || !arguments[i].is_lvalue))
 					return error(arguments[i].location, 3025, "l-value specifies const object for an 'out' parameter"), false;
@@ -849,7 +855,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 				if (arguments[i].type.components() > param_type.components())
 					warning(arguments[i].location, 3206, "implicit truncation of vector type");
 
-				if (symbol.op == symbol_type::function || param_type.has(type::q_out))
+				if (callee.op == symbol_type::function || param_type.has(type::q_out))
 				{
 					if (param_type.is_sampler() || param_type.is_storage() || param_type.has(type::q_groupshared) /* Special case for atomic intrinsics */)
 					{
@@ -898,11 +904,11 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 			}
 
 			// Check if the call resolving found an intrinsic or function and invoke the corresponding code
-			const auto result = symbol.op == symbol_type::function ?
-				_codegen->emit_call(location, symbol.id, symbol.type, parameters) :
-				_codegen->emit_call_intrinsic(location, symbol.id, symbol.type, parameters);
+			const auto result = callee.op == symbol_type::function ?
+				_codegen->emit_call(location, callee.id, callee.type, parameters) :
+				_codegen->emit_call_intrinsic(location, callee.id, callee.type, parameters);
 
-			exp.reset_to_rvalue(location, result, symbol.type);
+			exp.reset_to_rvalue(location, result, callee.type);
 
 			// Copy out parameters from parameter variables back to the argument access chains
 			for (size_t i = 0; i < arguments.size(); ++i)
@@ -919,35 +925,40 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 			if (_current_function != nullptr)
 			{
 				// Calling a function makes the caller inherit all sampler and storage object references from the callee
-				_current_function->referenced_samplers.insert(symbol.function->referenced_samplers.begin(), symbol.function->referenced_samplers.end());
-				_current_function->referenced_storages.insert(symbol.function->referenced_storages.begin(), symbol.function->referenced_storages.end());
+				_current_function->referenced_samplers.insert(callee.function->referenced_samplers.begin(), callee.function->referenced_samplers.end());
+				_current_function->referenced_storages.insert(callee.function->referenced_storages.begin(), callee.function->referenced_storages.end());
+
+				// Keep track of all functions that are called from the current function (including indirectly, via the callee)
+				if (callee.op == symbol_type::function)
+					_current_function->referenced_functions.insert(callee.id);
+				_current_function->referenced_functions.insert(callee.function->referenced_functions.begin(), callee.function->referenced_functions.end());
 			}
 		}
-		else if (symbol.op == symbol_type::invalid)
+		else if (symbol->op == symbol_type::invalid)
 		{
 			// Show error if no symbol matching the identifier was found
 			return error(location, 3004, "undeclared identifier '" + identifier + '\''), false;
 		}
-		else if (symbol.op == symbol_type::variable)
+		else if (symbol->op == symbol_type::variable)
 		{
-			assert(symbol.id != 0);
+			assert(symbol->id != 0);
 			// Simply return the pointer to the variable, dereferencing is done on site where necessary
-			exp.reset_to_lvalue(location, symbol.id, symbol.type);
+			exp.reset_to_lvalue(location, symbol->id, symbol->type);
 
 			if (_current_function != nullptr &&
-				symbol.scope.level == symbol.scope.namespace_level && symbol.id != 0xFFFFFFFF) // Ignore invalid symbols that were added during error recovery
+				symbol->scope.level == symbol->scope.namespace_level && symbol->id != 0xFFFFFFFF) // Ignore invalid symbols that were added during error recovery
 			{
 				// Keep track of any global sampler or storage objects referenced in the current function
-				if (symbol.type.is_sampler())
-					_current_function->referenced_samplers.insert(symbol.id);
-				if (symbol.type.is_storage())
-					_current_function->referenced_storages.insert(symbol.id);
+				if (symbol->type.is_sampler())
+					_current_function->referenced_samplers.insert(symbol->id);
+				if (symbol->type.is_storage())
+					_current_function->referenced_storages.insert(symbol->id);
 			}
 		}
-		else if (symbol.op == symbol_type::constant)
+		else if (symbol->op == symbol_type::constant)
 		{
 			// Constants are loaded into the access chain
-			exp.reset_to_rvalue_constant(location, symbol.constant, symbol.type);
+			exp.reset_to_rvalue_constant(location, symbol->constant, symbol->type);
 		}
 		else
 		{
@@ -991,7 +1002,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 				return false;
 
 			location = std::move(_token.location);
-			const auto subscript = std::move(_token.literal_as_string);
+			const std::string_view subscript = _token.literal_as_string;
 
 			if (accept('(')) // Methods (function calls on types) are not supported right now
 			{
@@ -1010,7 +1021,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 			{
 				const size_t length = subscript.size();
 				if (length > 4)
-					return error(location, 3018, "invalid subscript '" + subscript + "', swizzle too long"), false;
+					return error(location, 3018, "invalid subscript '" + std::string(subscript) + "', swizzle too long"), false;
 
 				bool is_const = false;
 				signed char offsets[4] = { -1, -1, -1, -1 };
@@ -1033,13 +1044,13 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 					case 'p': offsets[i] = 2, set[i] = stpq; break;
 					case 'q': offsets[i] = 3, set[i] = stpq; break;
 					default:
-						return error(location, 3018, "invalid subscript '" + subscript + '\''), false;
+						return error(location, 3018, "invalid subscript '" + std::string(subscript) + '\''), false;
 					}
 
 					if (i > 0 && (set[i] != set[i - 1]))
-						return error(location, 3018, "invalid subscript '" + subscript + "', mixed swizzle sets"), false;
+						return error(location, 3018, "invalid subscript '" + std::string(subscript) + "', mixed swizzle sets"), false;
 					if (static_cast<unsigned int>(offsets[i]) >= exp.type.rows)
-						return error(location, 3018, "invalid subscript '" + subscript + "', swizzle out of range"), false;
+						return error(location, 3018, "invalid subscript '" + std::string(subscript) + "', swizzle out of range"), false;
 
 					// The result is not modifiable if a swizzle appears multiple times
 					for (size_t k = 0; k < i; ++k)
@@ -1059,7 +1070,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 			{
 				const size_t length = subscript.size();
 				if (length < 3)
-					return error(location, 3018, "invalid subscript '" + subscript + '\''), false;
+					return error(location, 3018, "invalid subscript '" + std::string(subscript) + '\''), false;
 
 				bool is_const = false;
 				signed char offsets[4] = { -1, -1, -1, -1 };
@@ -1073,15 +1084,15 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 						subscript[i + set + 1] > '3' + coefficient ||
 						subscript[i + set + 2] < '0' + coefficient ||
 						subscript[i + set + 2] > '3' + coefficient)
-						return error(location, 3018, "invalid subscript '" + subscript + '\''), false;
+						return error(location, 3018, "invalid subscript '" + std::string(subscript) + '\''), false;
 					if (set && subscript[i + 1] != 'm')
-						return error(location, 3018, "invalid subscript '" + subscript + "', mixed swizzle sets"), false;
+						return error(location, 3018, "invalid subscript '" + std::string(subscript) + "', mixed swizzle sets"), false;
 
 					const unsigned int row = static_cast<unsigned int>((subscript[i + set + 1] - '0') - coefficient);
 					const unsigned int col = static_cast<unsigned int>((subscript[i + set + 2] - '0') - coefficient);
 
 					if ((row >= exp.type.rows || col >= exp.type.cols) || j > 3)
-						return error(location, 3018, "invalid subscript '" + subscript + "', swizzle out of range"), false;
+						return error(location, 3018, "invalid subscript '" + std::string(subscript) + "', swizzle out of range"), false;
 
 					offsets[j] = static_cast<signed char>(row * 4 + col);
 
@@ -1112,7 +1123,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 				}
 
 				if (member_index >= member_list.size())
-					return error(location, 3018, "invalid subscript '" + subscript + '\''), false;
+					return error(location, 3018, "invalid subscript '" + std::string(subscript) + '\''), false;
 
 				// Add field index to current access chain
 				exp.add_member_access(member_index, member_list[member_index].type);
@@ -1121,11 +1132,11 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 			{
 				const size_t length = subscript.size();
 				if (length > 4)
-					return error(location, 3018, "invalid subscript '" + subscript + "', swizzle too long"), false;
+					return error(location, 3018, "invalid subscript '" + std::string(subscript) + "', swizzle too long"), false;
 
 				for (size_t i = 0; i < length; ++i)
 					if ((subscript[i] != 'x' && subscript[i] != 'r' && subscript[i] != 's') || i > 3)
-						return error(location, 3018, "invalid subscript '" + subscript + '\''), false;
+						return error(location, 3018, "invalid subscript '" + std::string(subscript) + '\''), false;
 
 				// Promote scalar to vector type using cast
 				auto target_type = exp.type;
@@ -1138,7 +1149,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 			}
 			else
 			{
-				error(location, 3018, "invalid subscript '" + subscript + '\'');
+				error(location, 3018, "invalid subscript '" + std::string(subscript) + '\'');
 				return false;
 			}
 		}
@@ -7,6 +7,7 @@
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
 #include <cassert>
+#include <algorithm> // std::min
 #include <functional>
 
 struct on_scope_exit
@@ -17,14 +18,30 @@ struct on_scope_exit
 	std::function<void()> leave;
 };
 
-bool reshadefx::parser::parse(std::string input, codegen *backend)
+static bool contains_jump_statement(const std::vector<reshadefx::compact_token> &tokens, size_t begin, size_t end)
 {
-	_lexer.reset(new lexer(std::move(input)));
+	for (size_t i = begin; i < end; ++i)
+		if (tokens[i] == reshadefx::tokenid::break_ || tokens[i] == reshadefx::tokenid::continue_ || tokens[i] == reshadefx::tokenid::return_ || tokens[i] == reshadefx::tokenid::discard_)
+			return true;
+	return false;
+}
+
+bool reshadefx::parser::parse(std::string_view input, codegen *backend)
+{
+	_lexer.reset(new lexer(input, true, true, true, false, false, true, location(), &_sources));
+
+	// Lex the entire input up front, so that backtracking does not have to do so again
+	_tokens.clear();
+	do
+		_tokens.emplace_back(_lexer->lex());
+	while (_tokens.back() != tokenid::end_of_file);
+
+	_token_next_index = 0;
+	_token_next = _tokens[0].expand();
 
 	// Set backend for subsequent code-generation
 	_codegen = backend;
-
-	consume();
+	_codegen->set_source_table(&_sources);
 
 	bool parse_success = true;
 	bool current_success = true;
@@ -49,7 +66,7 @@ void reshadefx::parser::parse_top(bool &parse_success)
 			return;
 		}
 
-		const auto name = std::move(_token.literal_as_string);
+		const std::string name(_token.literal_as_string);
 
 		if (!expect('{'))
 		{
@@ -93,7 +110,7 @@ void reshadefx::parser::parse_top(bool &parse_success)
 
 			if (peek('('))
 			{
-				const auto name = std::move(_token.literal_as_string);
+				const std::string name(_token.literal_as_string);
 				// This is definitely a function declaration, so parse it
 				if (!parse_function(type, name))
 				{
@@ -113,7 +130,7 @@ void reshadefx::parser::parse_top(bool &parse_success)
 						parse_success = false;
 						return;
 					}
-					const auto name = std::move(_token.literal_as_string);
+					const std::string name(_token.literal_as_string);
 					if (!parse_variable(type, name, true))
 					{
 						// Insert dummy variable into symbol table, so later references can be resolved despite the error
@@ -167,7 +184,7 @@ bool reshadefx::parser::parse_statement(bool scoped)
 			switch_call = (0x8 << 4)
 		};
 
-		const auto attribute = std::move(_token_next.literal_as_string);
+		const std::string_view attribute = _token_next.literal_as_string;
 
 		if (!expect(tokenid::identifier) || !expect(']'))
 			return false;
@@ -225,6 +242,28 @@ bool reshadefx::parser::parse_statement(bool scoped)
 			condition.add_cast_operation({ type::t_bool, 1, 1 });
 
 			const codegen::id condition_value = _codegen->emit_load(condition);
+
+			// Only generate code for the branch that is taken if the condition is known at compile time (e.g. because it only depends on preprocessor macros or the counter of an unrolled loop)
+			if (condition.is_constant && _codegen->is_optimizing())
+			{
+				const bool condition_result = condition.constant.as_uint[0] != 0;
+				const size_t true_statement_end = find_statement_end(_token_next_index);
+				const size_t false_statement_end = _tokens[true_statement_end] == tokenid::else_ ? find_statement_end(true_statement_end + 1) : true_statement_end;
+
+				// The taken branch is added to the current block, so this only works if it does not leave that block early
+				if (condition_result ?
+						!contains_jump_statement(_tokens, _token_next_index, true_statement_end) :
+						!contains_jump_statement(_tokens, true_statement_end, false_statement_end))
+				{
+					if (condition_result ? !parse_statement(true) : !parse_statement_unreachable())
+						return false;
+					if (accept(tokenid::else_) && (condition_result ? !parse_statement_unreachable() : !parse_statement(true)))
+						return false;
+
+					return true;
+				}
+			}
+
 			const codegen::id condition_block = _codegen->leave_block_and_branch_conditional(condition_value, true_block, false_block);
 
 			{ // Then block of the if statement
@@ -378,12 +417,63 @@ bool reshadefx::parser::parse_statement(bool scoped)
 		#pragma region For
 		if (accept(tokenid::for_))
 		{
+			const size_t loop_index = _token_next_index - 1;
+
 			if (!expect('('))
 				return false;
 
 			enter_scope();
 			on_scope_exit _([this]() { leave_scope(); });
 
+			// Unroll loops with the 'unroll' attribute and a constant trip count into straight-line code
+			type counter_type;
+			std::string counter_name;
+			std::vector<int> counter_values;
+			size_t body_index = 0;
+			if (_codegen->is_optimizing() && !_codegen->is_unreachable() && (loop_control & 0x1) != 0 &&
+				find_constant_loop_iterations(counter_type, counter_name, counter_values, body_index))
+			{
+				// Check the loop without unrolling it first, so that the same errors are reported as when optimizations are disabled
+				_token_next_index = loop_index;
+				_token_next = _tokens[_token_next_index].expand();
+
+				if (!parse_statement_unreachable())
+					return false;
+
+				const size_t end_index = _token_next_index;
+
+				_unrolled_loop_depth++;
+				on_scope_exit unrolled_loop_scope([this]() { _unrolled_loop_depth--; });
+
+				for (size_t i = 0; i < counter_values.size(); ++i)
+				{
+					// Parse the loop body again for every iteration, with the loop counter declared as a named constant with the value of that iteration
+					_token_next_index = body_index;
+					_token_next = _tokens[_token_next_index].expand();
+
+					enter_scope();
+
+					symbol counter = { symbol_type::constant, 0, counter_type };
+					counter.constant.as_int[0] = counter_values[i];
+					insert_symbol(counter_name, counter);
+
+					const size_t errors_size = _errors.size();
+					const bool parse_success = parse_statement(true);
+
+					leave_scope();
+
+					if (!parse_success)
+						return false;
+
+					// Warnings were already reported when checking the loop
+					_errors.resize(errors_size);
+				}
+
+				assert(_token_next_index == end_index);
+
+				return true;
+			}
+
 			// Parse initializer first
 			if (type type; parse_type(type))
 			{
@@ -391,7 +481,7 @@ bool reshadefx::parser::parse_statement(bool scoped)
 				do { // There may be multiple declarations behind a type, so loop through them
 					if (count++ > 0 && !expect(','))
 						return false;
-					if (!expect(tokenid::identifier) || !parse_variable(type, std::move(_token.literal_as_string)))
+					if (!expect(tokenid::identifier) || !parse_variable(type, std::string(_token.literal_as_string)))
 						return false;
 				} while (!peek(';'));
 			}
@@ -713,7 +803,7 @@ bool reshadefx::parser::parse_statement(bool scoped)
 			if (count++ > 0 && !expect(','))
 				// Try to consume the rest of the declaration so that parsing may continue despite the error
 				return consume_until(';'), false;
-			if (!expect(tokenid::identifier) || !parse_variable(type, std::move(_token.literal_as_string)))
+			if (!expect(tokenid::identifier) || !parse_variable(type, std::string(_token.literal_as_string)))
 				return consume_until(';'), false;
 		} while (!peek(';'));
 
@@ -730,6 +820,36 @@ bool reshadefx::parser::parse_statement(bool scoped)
 
 	return false;
 }
+bool reshadefx::parser::parse_statement_unreachable()
+{
+	// Still parse the statement, so that the same errors are reported as when it is reachable, but add its code to a block that is never branched to, so that it does not end up in the result
+	const codegen::id current_block = _codegen->set_block(0);
+	_codegen->enter_block(_codegen->create_block());
+	const bool was_unreachable = _codegen->set_unreachable(true);
+
+	const size_t errors_size = _errors.size();
+	const size_t statement_end = find_statement_end(_token_next_index);
+
+	bool parse_success = parse_statement(true);
+
+	// The counter of an unrolled loop is a constant, which can cause errors in code that is never reached with a particular counter value (like an out of bounds array index)
+	// The loop body was already checked without that before unrolling it, so any errors here are caused by the constant counter and can be ignored
+	if (!parse_success && _unrolled_loop_depth != 0)
+	{
+		_errors.resize(errors_size);
+
+		_token_next_index = statement_end;
+		_token_next = _tokens[_token_next_index].expand();
+
+		parse_success = true;
+	}
+
+	_codegen->set_unreachable(was_unreachable);
+	_codegen->set_block(current_block);
+
+	return parse_success;
+}
+
 bool reshadefx::parser::parse_statement_block(bool scoped)
 {
 	if (!expect('{'))
@@ -843,7 +963,7 @@ bool reshadefx::parser::parse_annotations(std::vector<annotation> &annotations)
 		if (!expect(tokenid::identifier))
 			return consume_until('>'), false;
 
-		auto name = std::move(_token.literal_as_string);
+		std::string name(_token.literal_as_string);
 
 		if (expression expression; !expect('=') || !parse_expression_multary(expression) || !expect(';'))
 			return consume_until('>'), false;
@@ -864,11 +984,11 @@ bool reshadefx::parser::parse_struct()
 	struct_info info;
 	// The structure name is optional
 	if (accept(tokenid::identifier))
-		info.name = std::move(_token.literal_as_string);
+		info.name = _token.literal_as_string;
 	else
 		info.name = "_anonymous_struct_" + std::to_string(location.line) + '_' + std::to_string(location.column);
 
-	info.unique_name = 'S' + current_scope().name + info.name;
+	info.unique_name = 'S' + std::string(current_scope().name) + info.name;
 	std::replace(info.unique_name.begin(), info.unique_name.end(), ':', '_');
 
 	if (!expect('{'))
@@ -891,7 +1011,7 @@ bool reshadefx::parser::parse_struct()
 			if (!expect(tokenid::identifier))
 				return consume_until('}'), accept(';'), false;
 
-			member.name = std::move(_token.literal_as_string);
+			member.name = _token.literal_as_string;
 			member.location = std::move(_token.location);
 
 			if (member.type.is_void())
@@ -933,7 +1053,7 @@ bool reshadefx::parser::parse_struct()
 				if (!expect(tokenid::identifier))
 					return consume_until('}'), accept(';'), false;
 
-				member.semantic = std::move(_token.literal_as_string);
+				member.semantic = _token.literal_as_string;
 				// Make semantic upper case to simplify comparison later on
 				std::transform(member.semantic.begin(), member.semantic.end(), member.semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
@@ -986,7 +1106,7 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 
 	function_info info;
 	info.name = name;
-	info.unique_name = 'F' + current_scope().name + name;
+	info.unique_name = 'F' + std::string(current_scope().name) + name;
 	std::replace(info.unique_name.begin(), info.unique_name.end(), ':', '_');
 
 	info.return_type = type;
@@ -1032,7 +1152,7 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 			break;
 		}
 
-		param.name = std::move(_token.literal_as_string);
+		param.name = _token.literal_as_string;
 		param.location = std::move(_token.location);
 
 		if (param.type.is_void())
@@ -1082,7 +1202,7 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 				break;
 			}
 
-			param.semantic = std::move(_token.literal_as_string);
+			param.semantic = _token.literal_as_string;
 			// Make semantic upper case to simplify comparison later on
 			std::transform(param.semantic.begin(), param.semantic.end(), param.semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
@@ -1114,7 +1234,7 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 		if (type.is_void())
 			return error(_token.location, 3076, '\'' + name + "': void function cannot have a semantic"), false;
 
-		info.return_semantic = std::move(_token.literal_as_string);
+		info.return_semantic = _token.literal_as_string;
 		// Make semantic upper case to simplify comparison later on
 		std::transform(info.return_semantic.begin(), info.return_semantic.end(), info.return_semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 	}
@@ -1221,7 +1341,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 			return error(_token.location, 3043, '\'' + name + "': local variables cannot have semantics"), false;
 
 		std::string &semantic = texture_info.semantic;
-		semantic = std::move(_token.literal_as_string);
+		semantic = _token.literal_as_string;
 
 		// Make semantic upper case to simplify comparison later on
 		std::transform(semantic.begin(), semantic.end(), semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
@@ -1281,7 +1401,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 				if (!expect(tokenid::identifier))
 					return consume_until('}'), false;
 
-				const auto property_name = std::move(_token.literal_as_string);
+				const std::string_view property_name = _token.literal_as_string;
 				const auto property_location = std::move(_token.location);
 
 				if (!expect('='))
@@ -1294,7 +1414,8 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 				if (accept(tokenid::identifier)) // Handle special enumeration names for property values
 				{
 					// Transform identifier to uppercase to do case-insensitive comparison
-					std::transform(_token.literal_as_string.begin(), _token.literal_as_string.end(), _token.literal_as_string.begin(), [](char c) { return static_cast<char>(toupper(c)); });
+					std::string value(_token.literal_as_string);
+					std::transform(value.begin(), value.end(), value.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
 					static const std::unordered_map<std::string, uint32_t> s_values = {
 						{ "NONE", 0 }, { "POINT", 0 },
@@ -1319,7 +1440,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 					};
 
 					// Look up identifier in list of possible enumeration names
-					if (const auto it = s_values.find(_token.literal_as_string);
+					if (const auto it = s_values.find(value);
 						it != s_values.end())
 						expression.reset_to_rvalue_constant(_token.location, it->second);
 					else // No match found, so rewind to parser state before the identifier was consumed and try parsing it as a normal expression
@@ -1358,7 +1479,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 					const int value = expression.constant.as_int[0];
 
 					if (value < 0) // There is little use for negative values, so warn in those cases
-						warning(expression.location, 3571, "negative value specified for property '" + property_name + '\'');
+						warning(expression.location, 3571, "negative value specified for property '" + std::string(property_name) + '\'');
 
 					if (property_name == "Width")
 						texture_info.width  = value > 0 ? value : 1;
@@ -1392,7 +1513,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 					else if (property_name == "MipLOD" || property_name == "MipLevel")
 						storage_info.level = value > 0 && value < std::numeric_limits<uint16_t>::max() ? static_cast<uint16_t>(value) : 0;
 					else
-						return error(property_location, 3004, "unrecognized property '" + property_name + '\''), consume_until('}'), false;
+						return error(property_location, 3004, "unrecognized property '" + std::string(property_name) + '\''), consume_until('}'), false;
 				}
 
 				if (!expect(';'))
@@ -1423,7 +1544,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 
 		texture_info.name = name;
 		// Add namespace scope to avoid name clashes
-		texture_info.unique_name = 'V' + current_scope().name + name;
+		texture_info.unique_name = 'V' + std::string(current_scope().name) + name;
 		std::replace(texture_info.unique_name.begin(), texture_info.unique_name.end(), ':', '_');
 
 		texture_info.annotations = std::move(sampler_info.annotations);
@@ -1443,7 +1564,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 
 		sampler_info.name = name;
 		// Add namespace scope to avoid name clashes
-		sampler_info.unique_name = 'V' + current_scope().name + name;
+		sampler_info.unique_name = 'V' + std::string(current_scope().name) + name;
 		std::replace(sampler_info.unique_name.begin(), sampler_info.unique_name.end(), ':', '_');
 
 		symbol = { symbol_type::variable, 0, type };
@@ -1458,7 +1579,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 
 		storage_info.name = name;
 		// Add namespace scope to avoid name clashes
-		storage_info.unique_name = 'V' + current_scope().name + name;
+		storage_info.unique_name = 'V' + std::string(current_scope().name) + name;
 		std::replace(storage_info.unique_name.begin(), storage_info.unique_name.end(), ':', '_');
 
 		storage_info.format = texture_info.format;
@@ -1489,7 +1610,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 	else
 	{
 		// Update global variable names to contain the namespace scope to avoid name clashes
-		std::string unique_name = global ? 'V' + current_scope().name + name : name;
+		std::string unique_name = global ? 'V' + std::string(current_scope().name) + name : name;
 		std::replace(unique_name.begin(), unique_name.end(), ':', '_');
 
 		symbol = { symbol_type::variable, 0, type };
@@ -1505,13 +1626,239 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 	return parse_success;
 }
 
+size_t reshadefx::parser::find_statement_end(size_t index) const
+{
+	// The last token is always the EOF token, so never go past it
+	const size_t last_index = _tokens.size() - 1;
+
+	// Returns the index after the closing bracket that matches the opening bracket at the specified index
+	const auto skip_brackets = [this, last_index](size_t index) {
+		for (unsigned int level = 0; index < last_index; ++index)
+		{
+			if (_tokens[index] == tokenid::parenthesis_open || _tokens[index] == tokenid::bracket_open || _tokens[index] == tokenid::brace_open)
+				++level;
+			else if ((_tokens[index] == tokenid::parenthesis_close || _tokens[index] == tokenid::bracket_close || _tokens[index] == tokenid::brace_close) && --level == 0)
+				return index + 1;
+		}
+		return last_index;
+	};
+
+	// Skip any attributes
+	while (_tokens[index] == tokenid::bracket_open)
+		index = skip_brackets(index);
+
+	switch (_tokens[index])
+	{
+	case tokenid::brace_open:
+		return skip_brackets(index);
+	case tokenid::if_:
+		index = find_statement_end(skip_brackets(index + 1));
+		if (_tokens[index] == tokenid::else_)
+			index = find_statement_end(index + 1);
+		return index;
+	case tokenid::for_:
+	case tokenid::while_:
+		return find_statement_end(skip_brackets(index + 1));
+	case tokenid::do_:
+		// Skip loop body, 'while' keyword, condition and semicolon
+		return std::min(skip_brackets(find_statement_end(index + 1) + 1) + 1, last_index);
+	case tokenid::switch_:
+		return skip_brackets(skip_brackets(index + 1));
+	default:
+		// Simple statements end with a semicolon that is not nested in any brackets (e.g. of an array initializer list)
+		while (index < last_index && _tokens[index] != tokenid::semicolon)
+		{
+			if (_tokens[index] == tokenid::parenthesis_open || _tokens[index] == tokenid::bracket_open || _tokens[index] == tokenid::brace_open)
+				index = skip_brackets(index);
+			else
+				++index;
+		}
+		return std::min(index + 1, last_index);
+	}
+}
+
+bool reshadefx::parser::find_constant_loop_iterations(type &counter_type, std::string &counter_name, std::vector<int> &counter_values, size_t &body_index) const
+{
+	size_t index = _token_next_index;
+
+	// Reads an integer literal or named constant, optionally negated, and advances the index past it
+	const auto read_value = [this](size_t &index, int &value) {
+		const bool negate = _tokens[index] == tokenid::minus;
+		if (negate)
+			++index;
+
+		if (_tokens[index] == tokenid::int_literal || _tokens[index] == tokenid::uint_literal)
+			value = _tokens[index].literal_as_int;
+		else if (const scoped_symbol &symbol = find_symbol(std::string(_tokens[index].literal_as_string()));
+			_tokens[index] == tokenid::identifier && symbol.op == symbol_type::constant && symbol.type.is_scalar() && symbol.type.is_integral())
+			value = symbol.constant.as_int[0];
+		else
+			return false;
+
+		if (negate)
+			value = -value;
+		++index;
+		return true;
+	};
+
+	// Only loops of the form "for (int i = a; i < b; i++)" (with the usual variations of the condition and step) are supported
+	if (_tokens[index] == tokenid::int_)
+		counter_type = { type::t_int, 1, 1, type::q_const };
+	else if (_tokens[index] == tokenid::uint_)
+		counter_type = { type::t_uint, 1, 1, type::q_const };
+	else
+		return false;
+
+	if (_tokens[++index] != tokenid::identifier)
+		return false;
+	counter_name = _tokens[index].literal_as_string();
+
+	int first_value = 0;
+	if (_tokens[++index] != tokenid::equal || !read_value(++index, first_value) || _tokens[index] != tokenid::semicolon)
+		return false;
+
+	const auto is_counter = [this, &counter_name](size_t index) {
+		return _tokens[index] == tokenid::identifier && _tokens[index].literal_as_string() == counter_name;
+	};
+
+	if (!is_counter(++index))
+		return false;
+	const tokenid condition_op = _tokens[++index];
+	int last_value = 0;
+	if (!read_value(++index, last_value) || _tokens[index] != tokenid::semicolon)
+		return false;
+
+	int step = 0;
+	if (is_counter(++index))
+	{
+		if (_tokens[++index] == tokenid::plus_plus)
+			step = 1;
+		else if (_tokens[index] == tokenid::minus_minus)
+			step = -1;
+		else if (_tokens[index] == tokenid::plus_equal || _tokens[index] == tokenid::minus_equal)
+		{
+			const bool negate = _tokens[index] == tokenid::minus_equal;
+			if (!read_value(++index, step))
+				return false;
+			if (negate)
+				step = -step;
+			--index;
+		}
+		else
+			return false;
+	}
+	else if ((_tokens[index] == tokenid::plus_plus || _tokens[index] == tokenid::minus_minus) && is_counter(index + 1))
+	{
+		step = _tokens[index++] == tokenid::plus_plus ? 1 : -1;
+	}
+
+	if (step == 0 || _tokens[++index] != tokenid::parenthesis_close)
+		return false;
+
+	body_index = index + 1;
+	const size_t body_end = find_statement_end(body_index);
+
+	// Limit the size of the unrolled code
+	const size_t max_iterations = 1024;
+	const size_t max_tokens = 65536;
+
+	for (int64_t value = first_value; counter_values.size() <= max_iterations; value += step)
+	{
+		bool condition_result = false;
+		switch (condition_op)
+		{
+		case tokenid::less:
+			condition_result = value < last_value;
+			break;
+		case tokenid::less_equal:
+			condition_result = value <= last_value;
+			break;
+		case tokenid::greater:
+			condition_result = value > last_value;
+			break;
+		case tokenid::greater_equal:
+			condition_result = value >= last_value;
+			break;
+		case tokenid::exclaim_equal:
+			condition_result = value != last_value;
+			break;
+		default:
+			return false;
+		}
+
+		if (!condition_result)
+			break;
+		// Values of unsigned counters cannot go negative
+		if (value < INT32_MIN || value > INT32_MAX || (value < 0 && !counter_type.is_signed()))
+			return false;
+
+		counter_values.push_back(static_cast<int>(value));
+	}
+
+	if (counter_values.empty() || counter_values.size() > max_iterations || counter_values.size() * (body_end - body_index) > max_tokens)
+		return false;
+
+	// The loop body may not exit early or modify the loop counter
+	if (contains_jump_statement(_tokens, body_index, body_end))
+		return false;
+
+	for (size_t i = body_index; i < body_end; ++i)
+	{
+		if (!is_counter(i) || _tokens[i - 1] == tokenid::dot)
+			continue;
+
+		switch (_tokens[i + 1])
+		{
+		case tokenid::equal:
+		case tokenid::percent_equal:
+		case tokenid::ampersand_equal:
+		case tokenid::star_equal:
+		case tokenid::plus_equal:
+		case tokenid::minus_equal:
+		case tokenid::slash_equal:
+		case tokenid::less_less_equal:
+		case tokenid::greater_greater_equal:
+		case tokenid::caret_equal:
+		case tokenid::pipe_equal:
+		case tokenid::plus_plus:
+		case tokenid::minus_minus:
+			return false;
+		default:
+			break;
+		}
+		if (_tokens[i - 1] == tokenid::plus_plus || _tokens[i - 1] == tokenid::minus_minus)
+			return false;
+
+		// Passing the counter to a function call, which may take it as an 'out' parameter (the innermost parenthesis that is not merely grouping an expression determines the call)
+		for (size_t k = i - 1, level = 0; k >= body_index; --k)
+		{
+			if (_tokens[k] == tokenid::parenthesis_close)
+				++level;
+			else if (_tokens[k] == tokenid::parenthesis_open && level-- == 0)
+			{
+				if (_tokens[k - 1] == tokenid::identifier)
+				{
+					const std::string_view callee = _tokens[k - 1].literal_as_string();
+					if (callee == "sincos" || callee == "modf" || callee == "frexp" || find_symbol(std::string(callee)).op == symbol_type::function)
+						return false;
+				}
+				if (_tokens[k - 1] != tokenid::parenthesis_open && _tokens[k - 1] != tokenid::comma)
+					break;
+				level = 0;
+			}
+		}
+	}
+
+	return true;
+}
+
 bool reshadefx::parser::parse_technique()
 {
 	if (!expect(tokenid::identifier))
 		return false;
 
 	technique_info info;
-	info.name = std::move(_token.literal_as_string);
+	info.name = _token.literal_as_string;
 
 	bool parse_success = parse_annotations(info.annotations);
 
@@ -1542,7 +1889,7 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 
 	// Passes can have an optional name
 	if (accept(tokenid::identifier))
-		info.name = std::move(_token.literal_as_string);
+		info.name = _token.literal_as_string;
 
 	bool parse_success = true;
 	bool targets_support_srgb = true;
@@ -1558,7 +1905,7 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 			return consume_until('}'), false;
 
 		auto location = std::move(_token.location);
-		const auto state = std::move(_token.literal_as_string);
+		const std::string_view state = _token.literal_as_string;
 
 		if (!expect('='))
 			return consume_until('}'), false;
@@ -1570,7 +1917,7 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 		if (is_shader_state || is_texture_state)
 		{
 			std::string identifier;
-			scoped_symbol symbol;
+			const scoped_symbol *symbol = nullptr;
 			if (!accept_symbol(identifier, symbol))
 				return consume_until('}'), false;
 
@@ -1606,19 +1953,19 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 			}
 
 			// Ignore invalid symbols that were added during error recovery
-			if (symbol.id != 0xFFFFFFFF)
+			if (symbol->id != 0xFFFFFFFF)
 			{
 				if (is_shader_state)
 				{
-					if (!symbol.id)
+					if (!symbol->id)
 						parse_success = false,
 						error(location, 3501, "undeclared identifier '" + identifier + "', expected function name");
-					else if (!symbol.type.is_function())
+					else if (!symbol->type.is_function())
 						parse_success = false,
 						error(location, 3020, "type mismatch, expected function name");
 					else {
 						// Look up the matching function info for this function definition
-						function_info &function_info = _codegen->find_function(symbol.id);
+						function_info &function_info = _codegen->find_function(symbol->id);
 
 						// We potentially need to generate a special entry point function which translates between function parameters and input/output variables
 						switch (state[0])
@@ -1645,14 +1992,14 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 				{
 					assert(is_texture_state);
 
-					if (!symbol.id)
+					if (!symbol->id)
 						parse_success = false,
 						error(location, 3004, "undeclared identifier '" + identifier + "', expected texture name");
-					else if (!symbol.type.is_texture())
+					else if (!symbol->type.is_texture())
 						parse_success = false,
 						error(location, 3020, "type mismatch, expected texture name");
 					else {
-						reshadefx::texture_info &target_info = _codegen->find_texture(symbol.id);
+						reshadefx::texture_info &target_info = _codegen->find_texture(symbol->id);
 						// Texture is used as a render target
 						target_info.render_target = true;
 
@@ -1687,7 +2034,8 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 			if (accept(tokenid::identifier)) // Handle special enumeration names for pass states
 			{
 				// Transform identifier to uppercase to do case-insensitive comparison
-				std::transform(_token.literal_as_string.begin(), _token.literal_as_string.end(), _token.literal_as_string.begin(), [](char c) { return static_cast<char>(toupper(c)); });
+				std::string value(_token.literal_as_string);
+				std::transform(value.begin(), value.end(), value.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
 				static const std::unordered_map<std::string, uint32_t> s_enum_values = {
 					{ "NONE", 0 }, { "ZERO", 0 }, { "ONE", 1 },
@@ -1730,7 +2078,7 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 				};
 
 				// Look up identifier in list of possible enumeration names
-				if (const auto it = s_enum_values.find(_token.literal_as_string);
+				if (const auto it = s_enum_values.find(value);
 					it != s_enum_values.end())
 					expression.reset_to_rvalue_constant(_token.location, it->second);
 				else // No match found, so rewind to parser state before the identifier was consumed and try parsing it as a normal expression
@@ -1801,7 +2149,7 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 				info.generate_mipmaps = (value != 0);
 			else
 				parse_success = false,
-				error(location, 3004, "unrecognized pass state '" + state + '\'');
+				error(location, 3004, "unrecognized pass state '" + std::string(state) + '\'');
 
 #undef SET_STATE_VALUE_INDEXED
 		}
@@ -5,6 +5,7 @@
 
 #include "effect_lexer.hpp"
 #include "effect_preprocessor.hpp"
+#include <mutex>
 #include <cassert>
 #include <algorithm> // std::find_if
 
@@ -103,6 +104,158 @@ static std::string escape_string(std::string s)
 	return '\"' + s + '\"';
 }
 
+static std::string find_include_guard(const std::vector<reshadefx::token> &tokens)
+{
+	using reshadefx::tokenid;
+
+	size_t index = 0;
+	const auto next = [&tokens, &index](bool skip_lines) -> const reshadefx::token & {
+		while (index + 1 < tokens.size() && (tokens[index] == tokenid::space || (skip_lines && tokens[index] == tokenid::end_of_line)))
+			index++;
+		return tokens[index++];
+	};
+
+	// File has to start with '#ifndef X' followed by '#define X'
+	if (next(true) != tokenid::hash_ifndef)
+		return std::string();
+	const reshadefx::token &guard = next(false);
+	if (guard != tokenid::identifier || next(false) != tokenid::end_of_line)
+		return std::string();
+	if (next(true) != tokenid::hash_def)
+		return std::string();
+	if (const reshadefx::token &define = next(false); define != tokenid::identifier || define.literal_as_string != guard.literal_as_string)
+		return std::string();
+
+	// The '#endif' closing the first '#ifndef' has to be the last token in the file, and there may be no '#else' or '#elif' for it
+	for (size_t level = 1; index < tokens.size(); ++index)
+	{
+		switch (tokens[index])
+		{
+		case tokenid::hash_if:
+		case tokenid::hash_ifdef:
+		case tokenid::hash_ifndef:
+			level++;
+			break;
+		case tokenid::hash_else:
+		case tokenid::hash_elif:
+			if (level == 1)
+				return std::string();
+			break;
+		case tokenid::hash_endif:
+			if (--level == 0)
+			{
+				index++;
+				return next(true) == tokenid::end_of_file ? std::string(guard.literal_as_string) : std::string();
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	return std::string();
+}
+
+static std::shared_ptr<const reshadefx::include_file> load_include_file(const std::filesystem::path &path)
+{
+	const auto file = std::make_shared<reshadefx::include_file>();
+	if (!read_file(path, file->data))
+		return nullptr;
+
+	file->source = file->sources.insert(path.u8string());
+
+	reshadefx::location start_location;
+	start_location.source = file->source;
+
+	// Lex the entire file in advance, using the same options as 'preprocessor::push_input', so that the tokens can be replayed by any preprocessor instance
+	file->lexer.reset(new reshadefx::lexer(
+		std::string_view(file->data),
+		true  /* ignore_comments */,
+		false /* ignore_whitespace */,
+		false /* ignore_pp_directives */,
+		false /* ignore_line_directives */,
+		true  /* ignore_keywords */,
+		false /* escape_string_literals */,
+		start_location,
+		&file->sources));
+
+	do
+		file->tokens.push_back(file->lexer->lex());
+	while (file->tokens.back() != reshadefx::tokenid::end_of_file);
+
+	file->guard_macro = find_include_guard(file->tokens);
+
+	return file;
+}
+
+reshadefx::include_file::include_file()
+{
+}
+reshadefx::include_file::~include_file()
+{
+}
+
+std::shared_ptr<const reshadefx::include_file> reshadefx::include_cache::load(const std::filesystem::path &path)
+{
+	std::error_code ec;
+	const std::filesystem::file_time_type modified_at = std::filesystem::last_write_time(path, ec);
+	if (ec)
+		return nullptr;
+
+	const std::string path_string = path.u8string();
+
+	{
+		const std::shared_lock<std::shared_mutex> lock(_mutex);
+
+		if (const auto it = _files.find(path_string);
+			it != _files.end() && it->second.modified_at == modified_at)
+		{
+			it->second.used = true;
+			_hits++;
+			return it->second.data;
+		}
+	}
+
+	// Read and lex file outside the lock, so that other threads are not blocked by this, at the risk of reading the same file concurrently in rare cases
+	std::shared_ptr<const include_file> data = load_include_file(path);
+	if (data == nullptr)
+		return nullptr;
+
+	_misses++;
+
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+
+	// Another thread may have read the same file in the meantime, in which case keep its copy so that all preprocessors share the same buffer
+	file &file = _files[path_string];
+	if (file.data == nullptr || file.modified_at != modified_at)
+	{
+		file.modified_at = modified_at;
+		file.data = std::move(data);
+	}
+
+	file.used = true;
+
+	return file.data;
+}
+void reshadefx::include_cache::clear()
+{
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+
+	_files.clear();
+}
+void reshadefx::include_cache::evict_unused()
+{
+	const std::unique_lock<std::shared_mutex> lock(_mutex);
+
+	for (auto it = _files.begin(); it != _files.end();)
+	{
+		if (it->second.used.exchange(false))
+			++it;
+		else
+			it = _files.erase(it);
+	}
+}
+
 reshadefx::preprocessor::preprocessor()
 {
 }
@@ -129,6 +282,9 @@ bool reshadefx::preprocessor::append_file(const std::filesystem::path &path)
 
 	_success = true; // Clear success flag before parsing a new file
 
+	// The output is usually at least as large as the input file, so avoid growing it repeatedly
+	_output.reserve(_output.size() + data.size());
+
 	push(std::move(data), path.u8string());
 	parse();
 
@@ -172,38 +328,68 @@ std::vector<std::pair<std::string, std::string>> reshadefx::preprocessor::used_m
 
 void reshadefx::preprocessor::error(const location &location, const std::string &message)
 {
-	_errors += location.source + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor error: " + message + '\n';
+	_errors += _sources[location.source] + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor error: " + message + '\n';
 	_success = false; // Unset success flag
 }
 void reshadefx::preprocessor::warning(const location &location, const std::string &message)
 {
-	_errors += location.source + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor warning: " + message + '\n';
+	_errors += _sources[location.source] + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor warning: " + message + '\n';
 }
 
 void reshadefx::preprocessor::push(std::string input, const std::string &name)
 {
-	location start_location = !name.empty() ?
+	push_input(std::move(input), name);
+}
+void reshadefx::preprocessor::push(std::string_view input, const std::string &name)
+{
+	push_input(input, name);
+}
+void reshadefx::preprocessor::push(const include_file &file, const std::string &name)
+{
+	input_level level = {};
+	level.source = _sources.insert(name);
+	level.input = file.data;
+	level.file = &file;
+	level.next_token.id = tokenid::unknown;
+	level.next_token.location.source = level.source;
+
+	push_level(std::move(level));
+}
+template <typename input_type>
+void reshadefx::preprocessor::push_input(input_type &&input, const std::string &name)
+{
+	input_level level = {};
+	level.source = _sources.insert(name);
+
+	location start_location;
+	if (level.source != 0)
 		// Start at the beginning of the file when pushing a new file
-		location(name, 1) :
+		start_location.source = level.source;
+	else
 		// Start with last known token location when pushing an unnamed string
-		_token.location;
+		start_location = _token.location;
 
-	input_level level = { name };
 	level.lexer.reset(new lexer(
-		std::move(input),
+		std::forward<input_type>(input),
 		true  /* ignore_comments */,
 		false /* ignore_whitespace */,
 		false /* ignore_pp_directives */,
 		false /* ignore_line_directives */,
 		true  /* ignore_keywords */,
 		false /* escape_string_literals */,
-		start_location));
+		start_location,
+		&_sources));
+	level.input = level.lexer->input_string();
 	level.next_token.id = tokenid::unknown;
 	level.next_token.location = start_location; // This is used in 'consume' to initialize the output location
 
+	push_level(std::move(level));
+}
+void reshadefx::preprocessor::push_level(input_level &&level)
+{
 	// Inherit hidden macros from parent
 	if (!_input_stack.empty())
-		level.hidden_macros = _input_stack.back().hidden_macros;
+		level.hidden_macros_parent = _input_stack.size() - 1;
 
 	_input_stack.push_back(std::move(level));
 	_next_input_index = _input_stack.size() - 1;
@@ -233,19 +419,38 @@ bool reshadefx::preprocessor::consume()
 
 	// Update location information after switching input levels
 	input_level &input = _input_stack[_current_input_index];
-	if (!input.name.empty() && input.name != _output_location.source)
+	if (input.source != 0 && input.source != _output_location.source)
 	{
-		_output += "#line " + std::to_string(input.next_token.location.line) + " \"" + input.name + "\"\n";
+		// Insert in front of the line that is currently being written, so that the directive applies to all of it
+		const std::string directive = "#line " + std::to_string(input.next_token.location.line) + " \"" + _sources[input.source] + "\"\n";
+		_output.insert(_output_line_start, directive);
+		_output_line_start += directive.size();
 		_output_location.line = input.next_token.location.line;
-		_output_location.source = input.name;
+		_output_location.source = input.source;
 	}
 
 	// Set current token
 	_token = std::move(input.next_token);
-	_current_token_raw_data = input.lexer->input_string().substr(_token.offset, _token.length);
+	_current_token_raw_data = input.input.substr(_token.offset, _token.length);
 
 	// Get the next token
-	input.next_token = input.lexer->lex();
+	if (input.file != nullptr)
+	{
+		// Replay pre-lexed tokens, stopping at the final EOF token
+		input.next_token = input.file->tokens[input.next_token_index];
+		if (input.next_token_index + 1 < input.file->tokens.size())
+			input.next_token_index++;
+
+		// Token locations reference the source table of the file, so translate them to the one of this preprocessor
+		if (const uint32_t source = input.next_token.location.source; source == input.file->source)
+			input.next_token.location.source = input.source;
+		else
+			input.next_token.location.source = _sources.insert(input.file->sources[source]);
+	}
+	else
+	{
+		input.next_token = input.lexer->lex();
+	}
 
 	// Verify string literals (since the lexer cannot throw errors itself)
 	if (_token == tokenid::string_literal && _current_token_raw_data.back() != '\"')
@@ -307,7 +512,7 @@ bool reshadefx::preprocessor::expect(tokenid token)
 			error(actual_token.location, "syntax error: unexpected new line");
 		else
 			error(actual_token.location, "syntax error: unexpected token '" +
-				_input_stack[_next_input_index].lexer->input_string().substr(actual_token.offset, actual_token.length) + '\'');
+				std::string(_input_stack[_next_input_index].input.substr(actual_token.offset, actual_token.length)) + '\'');
 
 		return false;
 	}
@@ -317,7 +522,8 @@ bool reshadefx::preprocessor::expect(tokenid token)
 
 void reshadefx::preprocessor::parse()
 {
-	std::string line;
+	// Tokens are written straight to the output, but a line is only complete once its end was reached, since a #line directive may still need to be inserted in front of it
+	_output_line_start = _output.size();
 
 	while (consume())
 	{
@@ -396,35 +602,43 @@ void reshadefx::preprocessor::parse()
 			parse_include();
 			continue;
 		case tokenid::hash_unknown:
-			error(_token.location, "unrecognized preprocessing directive '" + _token.literal_as_string + '\'');
+			error(_token.location, "unrecognized preprocessing directive '" + std::string(_token.literal_as_string) + '\'');
 			consume_until(tokenid::end_of_line);
 			continue;
 		case tokenid::end_of_line:
-			if (line.empty())
+			if (_output.size() == _output_line_start)
 				continue;
 			_output_location.line++;
 			if (_output_location.line != _token.location.line)
 			{
-				_output += "#line " + std::to_string(_token.location.line) + '\n';
+				_output.insert(_output_line_start, "#line " + std::to_string(_token.location.line) + '\n');
 				_output_location.line  = _token.location.line;
 			}
-			_output += line;
 			_output += '\n';
-			line.clear();
+			_output_line_start = _output.size();
+			update_output_hash();
 			continue;
 		case tokenid::identifier:
 			if (evaluate_identifier_as_macro())
 				continue;
 			[[fallthrough]];
 		default:
-			line += _current_token_raw_data;
+			_output += _current_token_raw_data;
 			break;
 		}
 	}
 
-	// Append the last line after the EOF was reached to the output
-	_output += line;
+	// Terminate the last line after the EOF was reached
 	_output += '\n';
+	_output_line_start = _output.size();
+	update_output_hash();
+}
+void reshadefx::preprocessor::update_output_hash()
+{
+	// Lines before the current one are complete and will no longer change (directives are only ever inserted in front of the current line), so can be hashed right away
+	assert(_output_hashed_size <= _output_line_start);
+	_output_hasher.update(_output.data() + _output_hashed_size, _output_line_start - _output_hashed_size);
+	_output_hashed_size = _output_line_start;
 }
 
 void reshadefx::preprocessor::parse_def()
@@ -436,11 +650,11 @@ void reshadefx::preprocessor::parse_def()
 
 	macro m;
 	const auto location = std::move(_token.location);
-	const auto macro_name = std::move(_token.literal_as_string);
+	const std::string macro_name(_token.literal_as_string);
 	const auto macro_name_end_offset = _token.offset + _token.length;
 
 	// Check input string here directly to ensure the parenthesis follows the macro name without any whitespace between
-	if (_input_stack[_current_input_index].lexer->input_string()[macro_name_end_offset] == '(')
+	if (_input_stack[_current_input_index].input[macro_name_end_offset] == '(')
 	{
 		accept(tokenid::parenthesis_open);
 
@@ -448,7 +662,7 @@ void reshadefx::preprocessor::parse_def()
 
 		while (accept(tokenid::identifier))
 		{
-			m.parameters.push_back(_token.literal_as_string);
+			m.parameters.emplace_back(_token.literal_as_string);
 
 			if (!accept(tokenid::comma))
 				break;
@@ -480,7 +694,7 @@ void reshadefx::preprocessor::parse_undef()
 	else if (_token.literal_as_string == "defined")
 		return warning(_token.location, "macro name 'defined' is reserved");
 
-	_macros.erase(_token.literal_as_string);
+	_macros.erase(std::string(_token.literal_as_string));
 }
 
 void reshadefx::preprocessor::parse_if()
@@ -506,7 +720,7 @@ void reshadefx::preprocessor::parse_ifdef()
 	if (!expect(tokenid::identifier))
 		return;
 
-	level.value = _macros.find(_token.literal_as_string) != _macros.end() ||
+	level.value = _macros.find(std::string(_token.literal_as_string)) != _macros.end() ||
 		// Check built-in macros as well
 		_token.literal_as_string == "__LINE__" ||
 		_token.literal_as_string == "__FILE__" ||
@@ -529,7 +743,7 @@ void reshadefx::preprocessor::parse_ifndef()
 	if (!expect(tokenid::identifier))
 		return;
 
-	level.value = _macros.find(_token.literal_as_string) == _macros.end() &&
+	level.value = _macros.find(std::string(_token.literal_as_string)) == _macros.end() &&
 		_token.literal_as_string != "__LINE__" &&
 		_token.literal_as_string != "__FILE__" &&
 		_token.literal_as_string != "__FILE_NAME__" &&
@@ -591,14 +805,14 @@ void reshadefx::preprocessor::parse_error()
 	const auto keyword_location = std::move(_token.location);
 	if (!expect(tokenid::string_literal))
 		return;
-	error(keyword_location, _token.literal_as_string);
+	error(keyword_location, std::string(_token.literal_as_string));
 }
 void reshadefx::preprocessor::parse_warning()
 {
 	const auto keyword_location = std::move(_token.location);
 	if (!expect(tokenid::string_literal))
 		return;
-	warning(keyword_location, _token.literal_as_string);
+	warning(keyword_location, std::string(_token.literal_as_string));
 }
 
 void reshadefx::preprocessor::parse_pragma()
@@ -607,7 +821,7 @@ void reshadefx::preprocessor::parse_pragma()
 	if (!expect(tokenid::identifier))
 		return;
 
-	std::string pragma = std::move(_token.literal_as_string);
+	std::string pragma(_token.literal_as_string);
 	std::vector<std::string> pragma_args;
 	int parentheses_level = accept(tokenid::parenthesis_open) ? 1 : 0;
 
@@ -627,13 +841,14 @@ void reshadefx::preprocessor::parse_pragma()
 				continue;
 		}
 
-		pragma_args.push_back(std::move(_current_token_raw_data));
+		pragma_args.emplace_back(_current_token_raw_data);
 	}
 
 	if (pragma == "once")
 	{
-		if (const auto it = _file_cache.find(_output_location.source); it != _file_cache.end())
-			it->second.clear();
+		// Keep the cached file contents intact, since lexers may still reference them, and instead skip any further includes of this file
+		if (_file_cache.find(_sources[_output_location.source]) != _file_cache.end())
+			_pragma_once_files.insert(_output_location.source);
 		return;
 	}
 
@@ -667,7 +882,7 @@ void reshadefx::preprocessor::parse_include()
 	}
 
 	std::filesystem::path file_name = std::filesystem::u8path(_token.literal_as_string);
-	std::filesystem::path file_path = std::filesystem::u8path(_output_location.source);
+	std::filesystem::path file_path = std::filesystem::u8path(_sources[_output_location.source]);
 	file_path.replace_filename(file_name);
 
 	if (std::error_code ec; !std::filesystem::exists(file_path, ec))
@@ -676,37 +891,52 @@ void reshadefx::preprocessor::parse_include()
 				break;
 
 	const std::string file_path_string = file_path.u8string();
+	const uint32_t file_source = _sources.insert(file_path_string);
 
 	// Detect recursive include and abort to avoid infinite loop
 	if (std::find_if(_input_stack.begin(), _input_stack.end(),
-		[&file_path_string](const input_level &level) { return level.name == file_path_string; }) != _input_stack.end())
+		[file_source](const input_level &level) { return level.source == file_source; }) != _input_stack.end())
 	{
 		error(_token.location, "recursive #include");
 		return;
 	}
 
-	std::string data;
-	if (auto it = _file_cache.find(file_path_string);
-		it != _file_cache.end())
+	auto it = _file_cache.find(file_path_string);
+	if (it == _file_cache.end())
 	{
-		data = it->second;
-	}
-	else
-	{
-		if (!read_file(file_path, data))
+		const std::shared_ptr<const include_file> data = _include_cache != nullptr ? _include_cache->load(file_path) : load_include_file(file_path);
+
+		if (data == nullptr)
 		{
 			error(keyword_location, "could not open included file '" + file_path_string + '\'');
 			consume_until(tokenid::end_of_line);
 			return;
 		}
 
-		_file_cache.emplace(file_path_string, data);
+		// Keep a reference to the file contents for the lifetime of this preprocessor, so that they stay the same even if the shared cache is updated
+		it = _file_cache.emplace(file_path_string, data).first;
 	}
 
+	const include_file &file = *it->second;
+
 	// Clear out input stack before pushing include so that hidden macros do not bleed into the include
 	while (_input_stack.size() > (_next_input_index + 1))
 		_input_stack.pop_back();
-	push(std::move(data), file_path_string);
+
+	// Files marked with '#pragma once' were already included and therefore contribute no further code
+	if (_pragma_once_files.find(file_source) != _pragma_once_files.end())
+		return push(std::string_view(""), file_path_string);
+
+	// Files with an include guard whose macro is already defined would be skipped entirely, so do not bother replaying their tokens
+	if (!file.guard_macro.empty() && _macros.find(file.guard_macro) != _macros.end())
+	{
+		// The '#ifndef' of the include guard would have been evaluated, so track its macro as used
+		_used_macros.emplace(file.guard_macro);
+		return push(std::string_view(""), file_path_string);
+	}
+
+	// The cache entries are never modified or removed, so the tokens can reference the file contents directly instead of copying them
+	push(file, file_path_string);
 }
 
 bool reshadefx::preprocessor::evaluate_expression()
@@ -873,7 +1103,7 @@ bool reshadefx::preprocessor::evaluate_expression()
 				std::filesystem::path file_name = std::filesystem::u8path(_token.literal_as_string);
 				if (has_parentheses && !expect(tokenid::parenthesis_close))
 					return false;
-				std::filesystem::path file_path = std::filesystem::u8path(_output_location.source);
+				std::filesystem::path file_path = std::filesystem::u8path(_sources[_output_location.source]);
 				file_path.replace_filename(file_name);
 
 				std::error_code ec;
@@ -890,7 +1120,7 @@ bool reshadefx::preprocessor::evaluate_expression()
 				const bool has_parentheses = accept(tokenid::parenthesis_open);
 				if (!expect(tokenid::identifier))
 					return false;
-				const std::string macro_name = std::move(_token.literal_as_string);
+				const std::string macro_name(_token.literal_as_string);
 				if (has_parentheses && !expect(tokenid::parenthesis_close))
 					return false;
 
@@ -1057,28 +1287,29 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 	}
 	if (_token.literal_as_string == "__FILE__")
 	{
-		push(escape_string(_token.location.source));
+		push(escape_string(_sources[_token.location.source]));
 		return true;
 	}
 	if (_token.literal_as_string == "__FILE_STEM__")
 	{
-		const std::filesystem::path file_stem = std::filesystem::u8path(_token.location.source).stem();
+		const std::filesystem::path file_stem = std::filesystem::u8path(_sources[_token.location.source]).stem();
 		push(escape_string(file_stem.u8string()));
 		return true;
 	}
 	if (_token.literal_as_string == "__FILE_NAME__")
 	{
-		const std::filesystem::path file_name = std::filesystem::u8path(_token.location.source).filename();
+		const std::filesystem::path file_name = std::filesystem::u8path(_sources[_token.location.source]).filename();
 		push(escape_string(file_name.u8string()));
 		return true;
 	}
 
-	const auto it = _macros.find(_token.literal_as_string);
+	const std::string macro_name(_token.literal_as_string);
+
+	const auto it = _macros.find(macro_name);
 	if (it == _macros.end())
 		return false;
 
-	const std::unordered_set<std::string> &hidden_macros = _input_stack[_current_input_index].hidden_macros;
-	if (hidden_macros.find(_token.literal_as_string) != hidden_macros.end())
+	if (is_hidden_macro(it->first))
 		return false;
 
 	const auto macro_location = _token.location;
@@ -1130,9 +1361,12 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 			}
 			else
 			{
-				const size_t last = argument.find_last_not_of(" \t");
-				argument = argument.substr(first, last - first + 1);
+				argument.erase(argument.find_last_not_of(" \t") + 1);
+				argument.erase(0, first);
 			}
+
+			// Terminate argument with a special character, so that 'expand_macro' can lex it in place and knows where it ends
+			argument += static_cast<char>(macro_replacement_argument);
 			arguments.push_back(std::move(argument));
 
 			if (parentheses_level < 0)
@@ -1141,17 +1375,27 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 	}
 
 	std::string input;
+	input.reserve(it->second.replacement_list.size());
 	expand_macro(it->first, it->second, arguments, input);
 
 	if (!input.empty())
 	{
 		push(std::move(input));
 
-		_input_stack[_current_input_index].hidden_macros.insert(it->first);
+		// Keys of the macro map stay at the same address until they are removed, so can reference them here
+		assert(_input_stack[_current_input_index].hidden_macro == nullptr);
+		_input_stack[_current_input_index].hidden_macro = &it->first;
 	}
 
 	return true;
 }
+bool reshadefx::preprocessor::is_hidden_macro(const std::string &name) const
+{
+	for (size_t level_index = _current_input_index; level_index < _input_stack.size(); level_index = _input_stack[level_index].hidden_macros_parent)
+		if (_input_stack[level_index].hidden_macro == &name)
+			return true;
+	return false;
+}
 
 void reshadefx::preprocessor::expand_macro(const std::string &name, const macro &macro, const std::vector<std::string> &arguments, std::string &out)
 {
@@ -1189,7 +1433,8 @@ void reshadefx::preprocessor::expand_macro(const std::string &name, const macro
 		case macro_replacement_stringize:
 			out.reserve(out.size() + 2 + arguments[index].size());
 			out += '"';
-			for (const char c : arguments[index])
+			// Skip the argument terminator added in 'evaluate_identifier_as_macro'
+			for (const char c : std::string_view(arguments[index]).substr(0, arguments[index].size() - 1))
 			{
 				// Adds backslashes to escape quotes
 				if (c == '"')
@@ -1199,7 +1444,8 @@ void reshadefx::preprocessor::expand_macro(const std::string &name, const macro
 			out += '"';
 			break;
 		case macro_replacement_argument:
-			push(arguments[index] + static_cast<char>(macro_replacement_argument));
+			// Lex the argument in place, it is alive until this loop has consumed all of its tokens up to the terminator
+			push(std::string_view(arguments[index]), std::string());
 			while (true)
 			{
 				// Consume all tokens here, so spaces are added to the output too
@@ -6,13 +6,83 @@
 #pragma once
 
 #include "effect_token.hpp"
-#include <memory> // std::unique_ptr
+#include "effect_hash.hpp"
+#include <memory> // std::unique_ptr, std::shared_ptr
+#include <atomic>
+#include <limits>
 #include <filesystem>
+#include <shared_mutex>
 #include <unordered_map>
 #include <unordered_set>
 
 namespace reshadefx
 {
+	/// <summary>
+	/// The contents of an included file, which are lexed only once and then replayed by every preprocessor instance that includes it.
+	/// </summary>
+	struct include_file
+	{
+		// Define constructor explicitly because lexer class is not included here
+		include_file();
+		~include_file();
+
+		std::string data;
+		// File names referenced by token locations (which can change in the middle of the file via #line directives)
+		source_table sources;
+		uint32_t source = 0;
+		std::vector<token> tokens;
+		// Name of the macro in an include guard surrounding the entire file (e.g. '#ifndef X #define X ... #endif'), or empty if there is none
+		std::string guard_macro;
+		// String literals may reference storage owned by the lexer, so keep it alive for as long as the tokens are
+		std::unique_ptr<class lexer> lexer;
+	};
+
+	/// <summary>
+	/// A thread-safe cache of included files, which can be shared between multiple preprocessor instances so that every file is only read from disk once.
+	/// </summary>
+	class include_cache
+	{
+	public:
+		/// <summary>
+		/// Gets the contents of the file at the specified <paramref name="path"/>, reading and lexing it only if it is not cached yet or was modified since it was cached.
+		/// </summary>
+		/// <param name="path">Path to the file to load.</param>
+		/// <returns>Immutable file contents, or <see langword="nullptr"/> if the file could not be read.</returns>
+		std::shared_ptr<const include_file> load(const std::filesystem::path &path);
+
+		/// <summary>
+		/// Removes all files from the cache.
+		/// </summary>
+		void clear();
+		/// <summary>
+		/// Removes all files that were not loaded since the last call to this, so that the cache only keeps files that are still included somewhere.
+		/// </summary>
+		void evict_unused();
+
+		/// <summary>
+		/// Gets the number of loads that were served from the cache.
+		/// </summary>
+		size_t hits() const { return _hits; }
+		/// <summary>
+		/// Gets the number of loads that had to read the file from disk.
+		/// </summary>
+		size_t misses() const { return _misses; }
+
+	private:
+		struct file
+		{
+			std::filesystem::file_time_type modified_at;
+			std::shared_ptr<const include_file> data;
+			// Set on every load, which may happen concurrently under a shared lock
+			std::atomic<bool> used = false;
+		};
+
+		std::shared_mutex _mutex;
+		std::unordered_map<std::string, file> _files;
+		std::atomic<size_t> _hits = 0;
+		std::atomic<size_t> _misses = 0;
+	};
+
 	/// <summary>
 	/// A C-style preprocessor implementation.
 	/// </summary>
@@ -36,6 +106,11 @@ namespace reshadefx
 		/// </summary>
 		/// <param name="path">Path to the directory to add.</param>
 		void add_include_path(const std::filesystem::path &path);
+		/// <summary>
+		/// Sets a cache to look up included files in before reading them from disk. This cache may be shared with other preprocessor instances.
+		/// </summary>
+		/// <param name="cache">Cache to use, or <see langword="nullptr"/> to only cache files for this preprocessor instance.</param>
+		void set_include_cache(std::shared_ptr<include_cache> cache) { _include_cache = std::move(cache); }
 
 		/// <summary>
 		/// Adds a new macro definition. This is equal to appending '#define name macro' to this preprocessor instance.
@@ -76,9 +151,15 @@ namespace reshadefx
 		const std::string &errors() const { return _errors; }
 		/// <summary>
 		/// Gets the current pre-processed output string.
+		/// Source locations are encoded in it as #line directives, which are only emitted where the location jumps.
 		/// </summary>
 		std::string &output() { return _output; }
 		const std::string &output() const { return _output; }
+		/// <summary>
+		/// Gets a hash of the pre-processed output string.
+		/// This is computed incrementally as the output is written, so getting it does not require another pass over the output.
+		/// </summary>
+		hash128 output_hash() const { return _output_hasher.finalize(); }
 
 		/// <summary>
 		/// Gets a list of all included files.
@@ -106,16 +187,27 @@ namespace reshadefx
 		};
 		struct input_level
 		{
-			std::string name;
+			uint32_t source;
+			std::string_view input;
+			// Either a lexer that processes the input on demand, or the pre-lexed tokens of an included file
 			std::unique_ptr<class lexer> lexer;
+			const include_file *file = nullptr;
+			size_t next_token_index = 0;
 			token next_token;
-			std::unordered_set<std::string> hidden_macros;
+			// Macro that was expanded into this input level, and the level whose hidden macros are inherited, so that they do not have to be copied into every level
+			const std::string *hidden_macro = nullptr;
+			size_t hidden_macros_parent = std::numeric_limits<size_t>::max();
 		};
 
 		void error(const location &location, const std::string &message);
 		void warning(const location &location, const std::string &message);
 
 		void push(std::string input, const std::string &name = std::string());
+		void push(std::string_view input, const std::string &name);
+		void push(const include_file &file, const std::string &name);
+		template <typename input_type>
+		void push_input(input_type &&input, const std::string &name);
+		void push_level(input_level &&level);
 
 		bool peek(tokenid token) const;
 		bool consume();
@@ -124,6 +216,7 @@ namespace reshadefx
 		bool expect(tokenid token);
 
 		void parse();
+		void update_output_hash();
 		void parse_def();
 		void parse_undef();
 		void parse_if();
@@ -139,13 +232,17 @@ namespace reshadefx
 
 		bool evaluate_expression();
 		bool evaluate_identifier_as_macro();
+		bool is_hidden_macro(const std::string &name) const;
 
 		void expand_macro(const std::string &name, const macro &macro, const std::vector<std::string> &arguments, std::string &out);
 		void create_macro_replacement_list(macro &macro);
 
 		bool _success = true;
 		std::string _output, _errors;
-		std::string _current_token_raw_data;
+		size_t _output_line_start = 0;
+		size_t _output_hashed_size = 0;
+		hasher _output_hasher;
+		std::string_view _current_token_raw_data;
 		reshadefx::token _token;
 		std::vector<if_level> _if_stack;
 		std::vector<input_level> _input_stack;
@@ -153,10 +250,13 @@ namespace reshadefx
 		size_t _current_input_index = 0;
 		unsigned short _recursion_count = 0;
 		location _output_location;
+		source_table _sources;
 		std::unordered_set<std::string> _used_macros;
 		std::unordered_map<std::string, macro> _macros;
 		std::vector<std::filesystem::path> _include_paths;
-		std::unordered_map<std::string, std::string> _file_cache;
+		std::shared_ptr<include_cache> _include_cache;
+		std::unordered_map<std::string, std::shared_ptr<const include_file>> _file_cache;
+		std::unordered_set<uint32_t> _pragma_once_files;
 		std::unordered_map<std::string, std::vector<std::string>> _used_pragmas;
 	};
 }
@@ -87,6 +87,14 @@ static const intrinsic s_intrinsics[] =
 	#include "effect_symbol_table_intrinsics.inl"
 };
 
+// Index of the intrinsic overloads by name (in declaration order), so that resolving a call only has to look at the overloads with a matching name
+static const std::unordered_map<std::string_view, std::vector<const intrinsic *>> s_intrinsic_overloads = []() {
+	std::unordered_map<std::string_view, std::vector<const intrinsic *>> overloads;
+	for (const intrinsic &intrinsic : s_intrinsics)
+		overloads[intrinsic.function.name].push_back(&intrinsic);
+	return overloads;
+}();
+
 #undef void
 #undef bool
 #undef bool2
@@ -169,7 +177,7 @@ void reshadefx::symbol_table::enter_scope()
 }
 void reshadefx::symbol_table::enter_namespace(const std::string &name)
 {
-	_current_scope.name += name + "::";
+	_current_scope.name = *_scope_names.insert(std::string(_current_scope.name) + name + "::").first;
 	_current_scope.level++;
 	_current_scope.namespace_level++;
 }
@@ -177,20 +185,20 @@ void reshadefx::symbol_table::leave_scope()
 {
 	assert(_current_scope.level > 0);
 
-	for (auto &symbol : _symbol_stack)
+	// Remove all local symbols that were added in this scope, in reverse order of insertion
+	for (; !_scope_undo_log.empty() && _scope_undo_log.back().first >= _current_scope.level; _scope_undo_log.pop_back())
 	{
-		std::vector<scoped_symbol> &scope_list = symbol.second;
+		std::vector<scoped_symbol> &scope_list = *_scope_undo_log.back().second;
 
-		for (auto scope_it = scope_list.begin(); scope_it != scope_list.end();)
+		for (auto scope_it = scope_list.end(); scope_it != scope_list.begin();)
 		{
+			--scope_it;
+
 			if (scope_it->scope.level > scope_it->scope.namespace_level &&
 				scope_it->scope.level >= _current_scope.level)
 			{
-				scope_it = scope_list.erase(scope_it);
-			}
-			else
-			{
-				++scope_it;
+				scope_list.erase(scope_it);
+				break;
 			}
 		}
 	}
@@ -202,7 +210,7 @@ void reshadefx::symbol_table::leave_namespace()
 	assert(_current_scope.level > 0);
 	assert(_current_scope.namespace_level > 0);
 
-	_current_scope.name.erase(_current_scope.name.substr(0, _current_scope.name.size() - 2).rfind("::") + 2);
+	_current_scope.name = _current_scope.name.substr(0, _current_scope.name.substr(0, _current_scope.name.size() - 2).rfind("::") + 2);
 	_current_scope.level--;
 	_current_scope.namespace_level--;
 }
@@ -219,7 +227,7 @@ bool reshadefx::symbol_table::insert_symbol(const std::string &name, const symbo
 	const auto insert_sorted = [](auto &vec, const auto &item) {
 		return vec.insert(
 			std::upper_bound(vec.begin(), vec.end(), item,
-				[](auto lhs, auto rhs) {
+				[](const auto &lhs, const auto &rhs) {
 					return lhs.scope.namespace_level < rhs.scope.namespace_level;
 				}), item);
 	};
@@ -237,7 +245,7 @@ bool reshadefx::symbol_table::insert_symbol(const std::string &name, const symbo
 			const auto previous_scope_name = _current_scope.name.substr(pos);
 
 			// Insert symbol into this scope
-			insert_sorted(_symbol_stack[previous_scope_name + name], scoped_symbol { symbol, scope });
+			insert_sorted(_symbol_stack[std::string(previous_scope_name) + name], scoped_symbol { symbol, scope });
 
 			// Continue walking up the scope chain
 			scope.level = ++scope.namespace_level;
@@ -246,27 +254,34 @@ bool reshadefx::symbol_table::insert_symbol(const std::string &name, const symbo
 	else
 	{
 		// This is a local symbol so it's sufficient to update the symbol stack with just the current scope
-		insert_sorted(_symbol_stack[name], scoped_symbol { symbol, _current_scope });
+		std::vector<scoped_symbol> &scope_list = _symbol_stack[name];
+		insert_sorted(scope_list, scoped_symbol { symbol, _current_scope });
+
+		// Symbols in namespace scopes are never removed, so only need to remember those in function scopes
+		if (_current_scope.level > _current_scope.namespace_level)
+			_scope_undo_log.emplace_back(_current_scope.level, &scope_list);
 	}
 
 	return true;
 }
 
-reshadefx::scoped_symbol reshadefx::symbol_table::find_symbol(const std::string &name) const
+const reshadefx::scoped_symbol &reshadefx::symbol_table::find_symbol(const std::string &name) const
 {
 	// Default to start search with current scope and walk back the scope chain
 	return find_symbol(name, _current_scope, false);
 }
-reshadefx::scoped_symbol reshadefx::symbol_table::find_symbol(const std::string &name, const scope &scope, bool exclusive) const
+const reshadefx::scoped_symbol &reshadefx::symbol_table::find_symbol(const std::string &name, const scope &scope, bool exclusive) const
 {
+	static const scoped_symbol no_symbol = {};
+
 	const auto stack_it = _symbol_stack.find(name);
 
 	// Check if symbol does exist
 	if (stack_it == _symbol_stack.end() || stack_it->second.empty())
-		return {};
+		return no_symbol;
 
 	// Walk up the scope chain starting at the requested scope level and find a matching symbol
-	scoped_symbol result = {};
+	const scoped_symbol *result = &no_symbol;
 
 	for (auto it = stack_it->second.rbegin(), end = stack_it->second.rend(); it != end; ++it)
 	{
@@ -278,11 +293,11 @@ reshadefx::scoped_symbol reshadefx::symbol_table::find_symbol(const std::string
 
 		if (it->op == symbol_type::constant || it->op == symbol_type::variable || it->op == symbol_type::structure)
 			return *it; // Variables and structures have the highest priority and are always picked immediately
-		else if (result.id == 0)
-			result = *it; // Function names have a lower priority, so continue searching in case a variable with the same name exists
+		else if (result->id == 0)
+			result = &*it; // Function names have a lower priority, so continue searching in case a variable with the same name exists
 	}
 
-	return result;
+	return *result;
 }
 
 static int compare_functions(const std::vector<reshadefx::expression> &arguments, const reshadefx::function_info *function1, const reshadefx::function_info *function2)
@@ -399,22 +414,23 @@ bool reshadefx::symbol_table::resolve_function_call(const std::string &name, con
 	}
 
 	// Try matching against intrinsic functions if no matching user-defined function was found up to this point
-	if (num_overloads == 0)
+	if (const auto intrinsic_it = num_overloads == 0 ? s_intrinsic_overloads.find(name) : s_intrinsic_overloads.end();
+		intrinsic_it != s_intrinsic_overloads.end())
 	{
-		for (const intrinsic &intrinsic : s_intrinsics)
+		for (const intrinsic *const intrinsic : intrinsic_it->second)
 		{
-			if (intrinsic.function.name != name || intrinsic.function.parameter_list.size() != arguments.size())
+			if (intrinsic->function.parameter_list.size() != arguments.size())
 				continue;
 
 			// A new possibly-matching intrinsic function was found, compare it against the current result
-			const int comparison = compare_functions(arguments, &intrinsic.function, result);
+			const int comparison = compare_functions(arguments, &intrinsic->function, result);
 
 			if (comparison < 0) // The new function is a better match
 			{
 				out_data.op = symbol_type::intrinsic;
-				out_data.id = static_cast<uint32_t>(intrinsic.id);
-				out_data.type = intrinsic.function.return_type;
-				out_data.function = &intrinsic.function;
+				out_data.id = static_cast<uint32_t>(intrinsic->id);
+				out_data.type = intrinsic->function.return_type;
+				out_data.function = &intrinsic->function;
 				result = out_data.function;
 				num_overloads = 1;
 			}
@@ -7,6 +7,7 @@
 
 #include "effect_module.hpp"
 #include <unordered_map> // Used for symbol lookup table
+#include <unordered_set>
 
 namespace reshadefx
 {
@@ -15,7 +16,8 @@ namespace reshadefx
 	/// </summary>
 	struct scope
 	{
-		std::string name;
+		// References a name interned by the symbol table (or a string literal), so that storing the scope with every symbol does not copy it
+		std::string_view name;
 		uint32_t level, namespace_level;
 	};
 
@@ -86,9 +88,10 @@ namespace reshadefx
 
 		/// <summary>
 		/// Looks for an existing symbol with the specified <paramref name="name"/>.
+		/// The returned reference is only valid until the next symbol is inserted or the current scope is left.
 		/// </summary>
-		scoped_symbol find_symbol(const std::string &name) const;
-		scoped_symbol find_symbol(const std::string &name, const scope &scope, bool exclusive) const;
+		const scoped_symbol &find_symbol(const std::string &name) const;
+		const scoped_symbol &find_symbol(const std::string &name, const scope &scope, bool exclusive) const;
 
 		/// <summary>
 		/// Searches for the best function or intrinsic overload matching the argument list.
@@ -97,7 +100,11 @@ namespace reshadefx
 
 	private:
 		scope _current_scope;
+		// Storage for the names of all namespaces entered so far, which scopes reference
+		std::unordered_set<std::string> _scope_names;
 		// Lookup table from name to matching symbols
 		std::unordered_map<std::string, std::vector<scoped_symbol>> _symbol_stack;
+		// List of symbol stack entries that local symbols were added to, together with the scope level they were added in, so that leaving a scope only has to visit those
+		std::vector<std::pair<uint32_t, std::vector<scoped_symbol> *>> _scope_undo_log;
 	};
 }
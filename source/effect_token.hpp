@@ -6,6 +6,8 @@
 #pragma once
 
 #include <string>
+#include <cstring> // std::memcpy
+#include <string_view>
 #include <vector>
 
 namespace reshadefx
@@ -15,14 +17,46 @@ namespace reshadefx
 	/// </summary>
 	struct location
 	{
-		location() : line(1), column(1) {}
-		explicit location(uint32_t line, uint32_t column = 1) : line(line), column(column) {}
-		explicit location(std::string source, uint32_t line, uint32_t column = 1) : source(std::move(source)), line(line), column(column) {}
+		location() : source(0), line(1), column(1) {}
+		explicit location(uint32_t line, uint32_t column = 1) : source(0), line(line), column(column) {}
 
-		std::string source;
+		// Index of the file name in the 'source_table' of the current run (zero if not associated with a file)
+		uint32_t source;
 		uint32_t line, column;
 	};
 
+	/// <summary>
+	/// A table of source file names, so that locations only need to store a small index instead of a copy of the name.
+	/// </summary>
+	class source_table
+	{
+	public:
+		source_table() : _names(1) {}
+
+		/// <summary>
+		/// Adds the specified file <paramref name="name"/> to the table if it does not exist yet.
+		/// </summary>
+		/// <returns>Index of the file name in the table (zero for an empty name).</returns>
+		uint32_t insert(std::string_view name)
+		{
+			// There are usually only a handful of different files, so a linear search is sufficient
+			for (size_t i = 0; i < _names.size(); ++i)
+				if (_names[i] == name)
+					return static_cast<uint32_t>(i);
+
+			_names.emplace_back(name);
+			return static_cast<uint32_t>(_names.size() - 1);
+		}
+
+		/// <summary>
+		/// Gets the file name at the specified <paramref name="index"/> in the table.
+		/// </summary>
+		const std::string &operator[](uint32_t index) const { return _names[index]; }
+
+	private:
+		std::vector<std::string> _names;
+	};
+
 	/// <summary>
 	/// A collection of identifiers for various possible tokens.
 	/// </summary>
@@ -237,10 +271,60 @@ namespace reshadefx
 			float literal_as_float;
 			double literal_as_double;
 		};
-		std::string literal_as_string;
+		// References either the input string of the lexer or storage owned by it, so is only valid for as long as that lexer is alive
+		std::string_view literal_as_string;
 
 		inline operator tokenid() const { return id; }
 
 		static std::string id_to_name(tokenid id);
 	};
+
+	/// <summary>
+	/// A smaller version of <see cref="token"/> for storing many tokens at once (32 instead of 56 bytes), which does not keep the offset and length in the input string.
+	/// </summary>
+	struct compact_token
+	{
+		compact_token() = default;
+		explicit compact_token(const token &tok) : id(tok.id), location(tok.location), literal_string_length(static_cast<uint32_t>(tok.literal_as_string.size()))
+		{
+			// A token either has a string or a numeric literal value, never both, so they can share the same storage
+			if (literal_string_length != 0)
+				literal_string_data = tok.literal_as_string.data();
+			else
+				std::memcpy(&literal_as_double, &tok.literal_as_double, sizeof(literal_as_double));
+		}
+
+		tokenid id = tokenid::unknown;
+		reshadefx::location location;
+		uint32_t literal_string_length = 0;
+		union
+		{
+			int literal_as_int;
+			unsigned int literal_as_uint;
+			float literal_as_float;
+			double literal_as_double = 0.0;
+			const char *literal_string_data;
+		};
+
+		inline operator tokenid() const { return id; }
+
+		std::string_view literal_as_string() const { return literal_string_length != 0 ? std::string_view(literal_string_data, literal_string_length) : std::string_view(); }
+
+		/// <summary>
+		/// Converts this back into a full token (with zero offset and length).
+		/// </summary>
+		token expand() const
+		{
+			token tok;
+			tok.id = id;
+			tok.location = location;
+			tok.offset = 0;
+			tok.length = 0;
+			if (literal_string_length != 0)
+				tok.literal_as_string = literal_as_string();
+			else
+				std::memcpy(&tok.literal_as_double, &literal_as_double, sizeof(literal_as_double));
+			return tok;
+		}
+	};
 }
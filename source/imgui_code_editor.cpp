@@ -1668,7 +1668,7 @@ void reshade::imgui::code_editor::colorize()
 			input_string.push_back(_lines[l][k].c);
 
 	reshadefx::lexer lexer(
-		input_string,
+		std::string_view(input_string),
 		false /* ignore_comments */,
 		true  /* ignore_whitespace */,
 		false /* ignore_pp_directives */,
@@ -0,0 +1,446 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause OR MIT
+ */
+
+#include "packed_cache.hpp"
+#include <vector>
+#include <limits>
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <Windows.h>
+
+// Identifies the file format, which has to be incremented whenever the layout of the file changes
+static constexpr uint32_t s_cache_magic = 0x43584652; // "RFXC"
+static constexpr uint32_t s_cache_version = 1;
+
+// Every entry is stored as a record header, followed by the key and then the data
+struct record_header
+{
+	uint32_t key_size;
+	uint32_t data_size;
+};
+struct file_header
+{
+	uint32_t magic;
+	uint32_t version;
+};
+
+static bool read_file(HANDLE file, uint64_t offset, void *data, uint32_t size)
+{
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = static_cast<DWORD>(offset);
+	overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+	DWORD read = 0;
+	return ReadFile(file, data, size, &read, &overlapped) && read == size;
+}
+
+static std::mutex s_cache_instances_mutex;
+static std::unordered_map<std::wstring, std::weak_ptr<reshade::packed_cache>> s_cache_instances;
+
+std::shared_ptr<reshade::packed_cache> reshade::packed_cache::open(const std::filesystem::path &path)
+{
+	const std::lock_guard<std::mutex> lock(s_cache_instances_mutex);
+
+	// Multiple runtimes in the same process may use the same cache directory, but only one of them may write to the file
+	std::weak_ptr<packed_cache> &instance = s_cache_instances[path.native()];
+	if (std::shared_ptr<packed_cache> cache = instance.lock())
+		return cache;
+
+	std::shared_ptr<packed_cache> cache(new packed_cache(path));
+	if (cache->_file == nullptr)
+		return nullptr;
+
+	instance = cache;
+	return cache;
+}
+
+reshade::packed_cache::packed_cache(const std::filesystem::path &path) : _path(path)
+{
+	if (open_file() && !read_index())
+	{
+		// The file is corrupted or of an older version, so start from scratch
+		if (!reset_file() || !read_index())
+			close_file();
+	}
+}
+reshade::packed_cache::~packed_cache()
+{
+	close_file();
+}
+
+void reshade::packed_cache::set_size_limit(uint64_t size_limit)
+{
+	const std::lock_guard<std::mutex> lock(_mutex);
+	_size_limit = size_limit;
+}
+
+bool reshade::packed_cache::load(const std::string &key, std::string &data)
+{
+	const std::lock_guard<std::mutex> lock(_mutex);
+
+	const auto it = _entries.find(key);
+	if (it == _entries.end())
+		return false;
+
+	// Entry may have been appended after the file was last mapped, in which case the view needs to be extended
+	if (it->second.offset + it->second.size > _view_size)
+		map_file();
+
+	data.resize(it->second.size);
+	if (!read_data(it->second.offset, data.data(), it->second.size))
+		return false;
+
+	it->second.last_use = ++_use_counter;
+	return true;
+}
+bool reshade::packed_cache::save(const std::string &key, const std::string &data)
+{
+	if (data.size() > std::numeric_limits<uint32_t>::max())
+		return false;
+
+	const std::lock_guard<std::mutex> lock(_mutex);
+
+	return write_record(key, data.data(), static_cast<uint32_t>(data.size()));
+}
+
+void reshade::packed_cache::clear()
+{
+	const std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_read_only)
+		return;
+
+	// Invalidate any compaction in progress, so that it does not bring back the removed entries
+	_generation++;
+
+	reset_file();
+}
+
+void reshade::packed_cache::compact()
+{
+	std::vector<std::pair<std::string, entry>> kept_entries;
+	uint64_t copied_file_size = 0;
+	uint64_t generation = 0;
+
+	{	const std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_read_only || _file == nullptr || _compacting)
+			return;
+
+		// Only worth rewriting the file if it is over the size limit or at least half of it is taken up by stale entries
+		if (_file_size <= _size_limit && (_file_size - _live_size) < _file_size / 2)
+			return;
+
+		// Sort entries from most to least recently used, so that the least recently used ones are evicted first when exceeding the size limit
+		std::vector<std::pair<const std::string *, const entry *>> sorted_entries;
+		sorted_entries.reserve(_entries.size());
+		for (const auto &[key, entry] : _entries)
+			sorted_entries.emplace_back(&key, &entry);
+		std::sort(sorted_entries.begin(), sorted_entries.end(),
+			[](const auto &lhs, const auto &rhs) { return lhs.second->last_use > rhs.second->last_use; });
+
+		uint64_t compacted_size = sizeof(file_header);
+		size_t num_kept_entries = 0;
+		for (; num_kept_entries < sorted_entries.size(); ++num_kept_entries)
+		{
+			const uint64_t record_size = sizeof(record_header) + sorted_entries[num_kept_entries].first->size() + sorted_entries[num_kept_entries].second->size;
+			if (compacted_size + record_size > _size_limit)
+				break;
+			compacted_size += record_size;
+		}
+
+		// Write kept entries from least to most recently used, so that the order in the file reflects their usage the next time it is opened
+		kept_entries.reserve(num_kept_entries);
+		for (size_t i = num_kept_entries; i-- > 0;)
+			kept_entries.emplace_back(*sorted_entries[i].first, *sorted_entries[i].second);
+
+		copied_file_size = _file_size;
+		generation = _generation;
+		_compacting = true;
+	}
+
+	// Write to a temporary file first and then replace the cache file with it, so that an interruption does not leave behind a broken cache
+	std::filesystem::path temp_path = _path;
+	temp_path += L".tmp";
+
+	const HANDLE temp_file = CreateFileW(temp_path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	const auto write_temp_file = [temp_file](const char *data, size_t size) {
+		DWORD written = 0;
+		return WriteFile(temp_file, data, static_cast<DWORD>(size), &written, nullptr) && written == size;
+	};
+
+	const file_header header = { s_cache_magic, s_cache_version };
+	bool success = temp_file != INVALID_HANDLE_VALUE && write_temp_file(reinterpret_cast<const char *>(&header), sizeof(header));
+
+	// Records are never modified after they were appended, so copy them through a separate handle without holding the lock, which keeps the cache usable in the meantime
+	// This streams one record at a time rather than going through the memory mapped view, so does not depend on enough address space being available to map the entire file
+	if (success)
+	{
+		const HANDLE source_file = CreateFileW(_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		success = source_file != INVALID_HANDLE_VALUE;
+
+		std::string record_data;
+		for (auto it = kept_entries.begin(); success && it != kept_entries.end(); ++it)
+		{
+			const std::string &key = it->first;
+			const entry &entry = it->second;
+
+			const record_header record = { static_cast<uint32_t>(key.size()), entry.size };
+			record_data.resize(sizeof(record) + key.size() + entry.size);
+			std::memcpy(record_data.data(), &record, sizeof(record));
+			std::memcpy(record_data.data() + sizeof(record), key.data(), key.size());
+
+			success = read_file(source_file, entry.offset, record_data.data() + sizeof(record) + key.size(), entry.size) && write_temp_file(record_data.data(), record_data.size());
+		}
+
+		if (source_file != INVALID_HANDLE_VALUE)
+			CloseHandle(source_file);
+	}
+
+	const std::lock_guard<std::mutex> lock(_mutex);
+
+	_compacting = false;
+
+	// Cache may have been cleared in the meantime, in which case the copied records are no longer wanted
+	success = success && generation == _generation && _file != nullptr;
+
+	// Copy records that were appended while the lock was not held too (these are at the end of the file and always complete, since they are written while holding the lock)
+	std::string appended_data;
+	for (uint64_t offset = copied_file_size; success && offset < _file_size; offset += appended_data.size())
+	{
+		appended_data.resize(static_cast<size_t>(std::min<uint64_t>(_file_size - offset, 1024 * 1024)));
+		success = read_file(static_cast<HANDLE>(_file), offset, appended_data.data(), static_cast<uint32_t>(appended_data.size())) && write_temp_file(appended_data.data(), appended_data.size());
+	}
+
+	if (temp_file != INVALID_HANDLE_VALUE)
+		CloseHandle(temp_file);
+
+	if (!success)
+	{
+		DeleteFileW(temp_path.c_str());
+		return;
+	}
+
+	close_file();
+
+	const bool replaced = MoveFileExW(temp_path.c_str(), _path.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+	if (!replaced)
+		DeleteFileW(temp_path.c_str());
+
+	// Read the index again, since offsets changed and evicted entries are gone (or from the unchanged file in case it could not be replaced)
+	_entries.clear();
+	if (open_file())
+		read_index();
+}
+
+bool reshade::packed_cache::open_file()
+{
+	assert(_file == nullptr);
+
+	_read_only = false;
+	_file_size = 0;
+	_live_size = 0;
+
+	// Other processes may read from the file while this one writes to it, but only one of them can write at a time
+	HANDLE file = CreateFileW(_path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		file = CreateFileW(_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		_read_only = true;
+	}
+
+	_file = file;
+
+	if (LARGE_INTEGER file_size;
+		GetFileSizeEx(file, &file_size))
+		_file_size = static_cast<uint64_t>(file_size.QuadPart);
+
+	// Initialize a new file with the header
+	if (_file_size == 0 && !_read_only)
+	{
+		const file_header header = { s_cache_magic, s_cache_version };
+		if (DWORD size = sizeof(header);
+			!WriteFile(file, &header, size, &size, nullptr) || size != sizeof(header))
+		{
+			close_file();
+			return false;
+		}
+
+		_file_size = sizeof(header);
+	}
+
+	_live_size = sizeof(file_header);
+
+	return true;
+}
+bool reshade::packed_cache::reset_file()
+{
+	_entries.clear();
+	close_file();
+
+	if (DeleteFileW(_path.c_str()) || GetLastError() == ERROR_FILE_NOT_FOUND)
+		return open_file();
+
+	// Deleting fails while the file is still opened elsewhere (e.g. by another process reading from it, or a compaction in progress), so truncate it down to just the header instead
+	if (!open_file() || _read_only)
+		return false;
+
+	LARGE_INTEGER position = {};
+	const file_header header = { s_cache_magic, s_cache_version };
+	if (DWORD size = sizeof(header);
+		!SetFilePointerEx(static_cast<HANDLE>(_file), position, nullptr, FILE_BEGIN) ||
+		!WriteFile(static_cast<HANDLE>(_file), &header, size, &size, nullptr) || size != sizeof(header) ||
+		!SetEndOfFile(static_cast<HANDLE>(_file)))
+	{
+		// Truncating fails too while another process has the file mapped, but new records are still appended correctly, so keep using it (the removed entries only come back the next time the file is opened)
+		return false;
+	}
+
+	_file_size = sizeof(header);
+	return true;
+}
+
+void reshade::packed_cache::close_file()
+{
+	unmap_file();
+
+	if (_file != nullptr)
+		CloseHandle(static_cast<HANDLE>(_file));
+	_file = nullptr;
+}
+
+bool reshade::packed_cache::map_file()
+{
+	unmap_file();
+
+	if (_file == nullptr || _file_size == 0)
+		return false;
+
+	_mapping = CreateFileMappingW(static_cast<HANDLE>(_file), nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (_mapping == nullptr)
+		return false;
+
+	_view = static_cast<const char *>(MapViewOfFile(static_cast<HANDLE>(_mapping), FILE_MAP_READ, 0, 0, 0));
+	if (_view == nullptr)
+	{
+		unmap_file();
+		return false;
+	}
+
+	_view_size = _file_size;
+	return true;
+}
+void reshade::packed_cache::unmap_file()
+{
+	if (_view != nullptr)
+		UnmapViewOfFile(_view);
+	_view = nullptr;
+	_view_size = 0;
+
+	if (_mapping != nullptr)
+		CloseHandle(static_cast<HANDLE>(_mapping));
+	_mapping = nullptr;
+}
+
+bool reshade::packed_cache::read_data(uint64_t offset, void *data, uint32_t size) const
+{
+	if (offset + size <= _view_size)
+	{
+		std::memcpy(data, _view + offset, size);
+		return true;
+	}
+
+	// Mapping can fail for large files when address space is limited (e.g. in 32-bit processes), so fall back to reading from the file directly
+	return read_file(static_cast<HANDLE>(_file), offset, data, size);
+}
+
+bool reshade::packed_cache::read_index()
+{
+	// Reading the index works without the mapped view too, it is just slower
+	map_file();
+
+	file_header header;
+	if (_file_size < sizeof(header) || !read_data(0, &header, sizeof(header)))
+		return false;
+	if (header.magic != s_cache_magic || header.version != s_cache_version)
+		return false;
+
+	uint64_t offset = sizeof(header);
+	while (_file_size - offset >= sizeof(record_header))
+	{
+		record_header record;
+		if (!read_data(offset, &record, sizeof(record)))
+			return false;
+
+		const uint64_t record_size = sizeof(record) + static_cast<uint64_t>(record.key_size) + record.data_size;
+		if (record_size > _file_size - offset)
+			break; // Record was only partially written (e.g. because the application crashed while doing so)
+
+		std::string key(record.key_size, '\0');
+		if (!read_data(offset + sizeof(record), key.data(), record.key_size))
+			return false;
+
+		// Later records replace earlier ones with the same key
+		if (const auto it = _entries.find(key); it != _entries.end())
+			_live_size -= sizeof(record_header) + key.size() + it->second.size;
+		_live_size += record_size;
+
+		// Records are ordered by their last use during compaction, so the position in the file works as initial usage order
+		_entries[std::move(key)] = { offset + sizeof(record) + record.key_size, record.data_size, ++_use_counter };
+
+		offset += record_size;
+	}
+
+	// Cut off any trailing partially written record, so that new records are appended directly after the last valid one
+	if (offset != _file_size && !_read_only)
+	{
+		unmap_file();
+
+		LARGE_INTEGER position;
+		position.QuadPart = static_cast<LONGLONG>(offset);
+		if (!SetFilePointerEx(static_cast<HANDLE>(_file), position, nullptr, FILE_BEGIN) || !SetEndOfFile(static_cast<HANDLE>(_file)))
+			return false;
+
+		_file_size = offset;
+		map_file();
+	}
+
+	return true;
+}
+
+bool reshade::packed_cache::write_record(const std::string &key, const char *data, uint32_t size)
+{
+	if (_read_only || _file == nullptr || key.size() > std::numeric_limits<uint32_t>::max())
+		return false;
+
+	// Write the entire record in a single call, so that it is either written completely or detected as partially written when reading the index next time
+	std::string record_data;
+	record_data.reserve(sizeof(record_header) + key.size() + size);
+	const record_header record = { static_cast<uint32_t>(key.size()), size };
+	record_data.append(reinterpret_cast<const char *>(&record), sizeof(record));
+	record_data.append(key);
+	record_data.append(data, size);
+
+	LARGE_INTEGER position;
+	position.QuadPart = static_cast<LONGLONG>(_file_size);
+	if (!SetFilePointerEx(static_cast<HANDLE>(_file), position, nullptr, FILE_BEGIN))
+		return false;
+
+	if (DWORD written = 0;
+		!WriteFile(static_cast<HANDLE>(_file), record_data.data(), static_cast<DWORD>(record_data.size()), &written, nullptr) || written != record_data.size())
+		return false;
+
+	if (const auto it = _entries.find(key); it != _entries.end())
+		_live_size -= sizeof(record_header) + key.size() + it->second.size;
+	_live_size += record_data.size();
+
+	_entries[key] = { _file_size + sizeof(record) + key.size(), size, ++_use_counter };
+	_file_size += record_data.size();
+
+	return true;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause OR MIT
+ */
+
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <filesystem>
+#include <unordered_map>
+
+namespace reshade
+{
+	/// <summary>
+	/// A key-value store that packs all entries into a single file, instead of storing every entry in a separate file.
+	/// New entries are appended to the end of the file, existing ones are read from a memory mapped view of it. The file is compacted when it contains too much stale data or exceeds the size limit, in which case the least recently used entries are evicted.
+	/// All methods are thread-safe.
+	/// </summary>
+	class packed_cache
+	{
+	public:
+		/// <summary>
+		/// Opens the cache file at the specified <paramref name="path"/> (or creates it if it does not exist yet).
+		/// Instances are shared within the process, so opening the same path again returns the same instance.
+		/// </summary>
+		/// <param name="path">Path to the cache file.</param>
+		/// <returns>Pointer to the cache, or <see langword="nullptr"/> if the file could not be opened.</returns>
+		static std::shared_ptr<packed_cache> open(const std::filesystem::path &path);
+
+		~packed_cache();
+
+		packed_cache(const packed_cache &) = delete;
+		packed_cache &operator=(const packed_cache &) = delete;
+
+		/// <summary>
+		/// Gets the path to the cache file.
+		/// </summary>
+		const std::filesystem::path &path() const { return _path; }
+
+		/// <summary>
+		/// Sets the maximum size in bytes the cache file may grow to before the least recently used entries are evicted during compaction.
+		/// </summary>
+		void set_size_limit(uint64_t size_limit);
+
+		/// <summary>
+		/// Gets the data stored under the specified <paramref name="key"/>.
+		/// </summary>
+		/// <param name="key">Key to look up.</param>
+		/// <param name="data">Reference filled with the data of the entry.</param>
+		/// <returns><see langword="true"/> if the key exists, <see langword="false"/> otherwise.</returns>
+		bool load(const std::string &key, std::string &data);
+		/// <summary>
+		/// Stores data under the specified <paramref name="key"/>, replacing any existing entry with the same key.
+		/// </summary>
+		/// <param name="key">Key to store the data under.</param>
+		/// <param name="data">Data of the entry.</param>
+		/// <returns><see langword="true"/> if the entry was written to the cache file, <see langword="false"/> otherwise.</returns>
+		bool save(const std::string &key, const std::string &data);
+
+		/// <summary>
+		/// Removes all entries from the cache.
+		/// </summary>
+		void clear();
+
+		/// <summary>
+		/// Rewrites the cache file without stale entries and evicts the least recently used ones until it fits the size limit, but only if that would free a significant amount of space.
+		/// This copies all kept entries to a new file, so should be called from a background thread. Other methods may be called while it is in progress.
+		/// </summary>
+		void compact();
+
+	private:
+		struct entry
+		{
+			uint64_t offset;
+			uint32_t size;
+			uint64_t last_use;
+		};
+
+		explicit packed_cache(const std::filesystem::path &path);
+
+		bool open_file();
+		bool reset_file();
+		void close_file();
+		bool map_file();
+		void unmap_file();
+		bool read_data(uint64_t offset, void *data, uint32_t size) const;
+		bool read_index();
+		bool write_record(const std::string &key, const char *data, uint32_t size);
+
+		const std::filesystem::path _path;
+		std::mutex _mutex;
+		void *_file = nullptr;
+		void *_mapping = nullptr;
+		const char *_view = nullptr;
+		uint64_t _view_size = 0;
+		uint64_t _file_size = 0;
+		uint64_t _live_size = 0;
+		uint64_t _size_limit = 512 * 1024 * 1024;
+		uint64_t _use_counter = 0;
+		uint64_t _generation = 0;
+		bool _read_only = false;
+		bool _compacting = false;
+		std::unordered_map<std::string, entry> _entries;
+	};
+}
@@ -17,7 +17,10 @@
 #include "input_freepie.hpp"
 #include "com_ptr.hpp"
 #include "process_utils.hpp"
+#include "packed_cache.hpp"
+#include "worker_pool.hpp"
 #include <set>
+#include <atomic>
 #include <thread>
 #include <cstring>
 #include <algorithm>
@@ -135,6 +138,59 @@ static std::vector<std::filesystem::path> find_files(const std::vector<std::file
 
 	return files;
 }
+static std::shared_ptr<const reshade::effect_include_snapshot> create_include_snapshot(const std::vector<std::filesystem::path> &search_paths)
+{
+	std::error_code ec;
+	std::set<std::filesystem::path> include_paths;
+
+	for (std::filesystem::path include_path : search_paths)
+	{
+		const bool recursive_search = include_path.filename() == L"**";
+		if (recursive_search)
+			include_path.remove_filename();
+
+		if (resolve_path(include_path))
+		{
+			include_paths.emplace(include_path);
+
+			if (recursive_search)
+			{
+				for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(include_path, std::filesystem::directory_options::skip_permission_denied, ec))
+					if (entry.is_directory(ec))
+						include_paths.emplace(entry);
+			}
+		}
+	}
+
+	const auto snapshot = std::make_shared<reshade::effect_include_snapshot>();
+	snapshot->include_paths.assign(include_paths.begin(), include_paths.end());
+
+	reshadefx::hasher fingerprint;
+	for (const std::filesystem::path &include_path : snapshot->include_paths)
+	{
+		fingerprint.update(include_path.u8string());
+		for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(include_path, std::filesystem::directory_options::skip_permission_denied, ec))
+		{
+			const std::filesystem::path extension = entry.path().extension();
+			if (extension == L".fx")
+			{
+				snapshot->effect_file_times.emplace(entry.path().native(), entry.last_write_time(ec).time_since_epoch().count());
+			}
+			else if (extension == L".fxh")
+			{
+				fingerprint.update(",");
+				fingerprint.update(entry.path().filename().u8string());
+				fingerprint.update("?");
+				fingerprint.update(std::to_string(entry.last_write_time(ec).time_since_epoch().count()));
+			}
+		}
+		fingerprint.update(";");
+	}
+
+	snapshot->fingerprint = fingerprint.finalize();
+
+	return snapshot;
+}
 
 static inline int format_color_bit_depth(reshade::api::format value)
 {
@@ -184,6 +240,9 @@ reshade::runtime::runtime(api::device *device, api::command_queue *graphics_queu
 {
 	assert(device != nullptr && graphics_queue != nullptr);
 
+	// Threads are kept alive for the lifetime of the runtime, rather than being spawned anew for every reload
+	_worker_pool = std::make_unique<worker_pool>();
+
 	_needs_update = check_for_update(_latest_version);
 
 	// Default shortcut PrtScrn
@@ -205,7 +264,8 @@ reshade::runtime::runtime(api::device *device, api::command_queue *graphics_queu
 }
 reshade::runtime::~runtime()
 {
-	assert(_worker_threads.empty());
+	assert(_worker_pool->is_idle());
+	assert(_screenshot_worker == nullptr || _screenshot_worker->is_idle());
 #if RESHADE_FX
 	assert(!_is_initialized && _techniques.empty());
 #endif
@@ -507,13 +567,12 @@ void reshade::runtime::on_reset()
 	_effect_stencil_tex = {};
 	_device->destroy_resource_view(_effect_stencil_dsv);
 	_effect_stencil_dsv = {};
-#else
-	for (std::thread &thread : _worker_threads)
-		if (thread.joinable())
-			thread.join();
-	_worker_threads.clear();
 #endif
 
+	// Screenshots are saved on a separate thread, so that waiting for effects to finish loading does not wait for them too
+	if (_screenshot_worker != nullptr)
+		_screenshot_worker->wait();
+
 	_device->destroy_pipeline(_copy_pipeline);
 	_copy_pipeline = {};
 	_device->destroy_pipeline_layout(_copy_pipeline_layout);
@@ -782,6 +841,7 @@ void reshade::runtime::load_config()
 	config.get("GENERAL", "SkipLoadingDisabledEffects", _effect_load_skipping);
 	config.get("GENERAL", "TextureSearchPaths", _texture_search_paths);
 	config.get("GENERAL", "IntermediateCachePath", _intermediate_cache_path);
+	config.get("GENERAL", "IntermediateCacheSizeLimit", _effect_cache_size_limit);
 
 	config.get("GENERAL", "PresetPath", _current_preset_path);
 	config.get("GENERAL", "PresetTransitionDuration", _preset_transition_duration);
@@ -847,6 +907,7 @@ void reshade::runtime::save_config() const
 	config.set("GENERAL", "SkipLoadingDisabledEffects", _effect_load_skipping);
 	config.set("GENERAL", "TextureSearchPaths", _texture_search_paths);
 	config.set("GENERAL", "IntermediateCachePath", _intermediate_cache_path);
+	config.set("GENERAL", "IntermediateCacheSizeLimit", _effect_cache_size_limit);
 
 	// Use ReShade DLL directory as base for relative preset paths (see 'resolve_preset_path')
 	std::filesystem::path relative_preset_path = _current_preset_path.lexically_proximate(g_reshade_base_path);
@@ -1166,7 +1227,7 @@ bool reshade::runtime::switch_to_next_preset(std::filesystem::path filter_path,
 	return true;
 }
 
-bool reshade::runtime::load_effect(const std::filesystem::path &source_file, const ini_file &preset, size_t effect_index, bool preprocess_required)
+bool reshade::runtime::load_effect(const std::filesystem::path &source_file, const ini_file &preset, const effect_include_snapshot &include_snapshot, size_t effect_index, bool preprocess_required)
 {
 	// Generate a unique string identifying this effect
 	std::string attributes;
@@ -1177,49 +1238,43 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 	attributes += "color_bit_depth=" + std::to_string(format_color_bit_depth(_back_buffer_format)) + ';';
 	attributes += "version=" + std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION) + ';';
 	attributes += "performance_mode=" + std::string(_performance_mode ? "1" : "0") + ';';
+	attributes += "debug_info=" + std::string(_no_debug_info ? "0" : "1") + ';';
 	attributes += "vendor=" + std::to_string(_vendor_id) + ';';
 	attributes += "device=" + std::to_string(_device_id) + ';';
 
-	std::set<std::filesystem::path> include_paths;
-	if (source_file.is_absolute())
-		include_paths.emplace(source_file.parent_path());
-	for (std::filesystem::path include_path : _effect_search_paths)
-	{
-		const bool recursive_search = include_path.filename() == L"**";
-		if (recursive_search)
-			include_path.remove_filename();
-
-		if (resolve_path(include_path))
-		{
-			include_paths.emplace(include_path);
+	// The include directories were only scanned once for all effects, so that only the effect file itself needs to be looked up here
+	attributes += "includes=" + include_snapshot.fingerprint.to_string() + ';';
 
-			if (recursive_search)
-			{
-				std::error_code ec;
-				for (const std::filesystem::directory_entry &entry : std::filesystem::recursive_directory_iterator(include_path, std::filesystem::directory_options::skip_permission_denied, ec))
-					if (entry.is_directory(ec))
-						include_paths.emplace(entry);
-			}
-		}
+	if (const auto it = include_snapshot.effect_file_times.find(source_file.native()); it != include_snapshot.effect_file_times.end())
+	{
+		attributes += "source_time=" + std::to_string(it->second) + ';';
+	}
+	else
+	{
+		std::error_code ec;
+		attributes += "source_time=" + std::to_string(std::filesystem::last_write_time(source_file, ec).time_since_epoch().count()) + ';';
 	}
 
-	for (const std::filesystem::path &include_path : include_paths)
+	// The directory of the effect file is always searched for includes too, even if it is not part of the effect search paths (in which case its headers are not part of the fingerprint)
+	std::vector<std::filesystem::path> additional_include_paths;
+	if (source_file.is_absolute() && !std::binary_search(include_snapshot.include_paths.begin(), include_snapshot.include_paths.end(), source_file.parent_path()))
 	{
 		std::error_code ec;
 
-		attributes += include_path.u8string();
-		for (const auto &entry : std::filesystem::directory_iterator(include_path, std::filesystem::directory_options::skip_permission_denied, ec))
+		attributes += source_file.parent_path().u8string();
+		for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(source_file.parent_path(), std::filesystem::directory_options::skip_permission_denied, ec))
 		{
-			const std::filesystem::path filename = entry.path().filename();
-			if (filename == source_file.filename() || filename.extension() == L".fxh")
+			if (entry.path().extension() == L".fxh")
 			{
 				attributes += ',';
-				attributes += filename.u8string();
+				attributes += entry.path().filename().u8string();
 				attributes += '?';
 				attributes += std::to_string(entry.last_write_time(ec).time_since_epoch().count());
 			}
 		}
 		attributes += ';';
+
+		additional_include_paths.push_back(source_file.parent_path());
 	}
 
 	std::vector<std::string> preprocessor_definitions = _global_preprocessor_definitions;
@@ -1228,7 +1283,7 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 	for (const std::string &definition : preprocessor_definitions)
 		attributes += definition + ';';
 
-	const size_t source_hash = std::hash<std::string>()(attributes);
+	const reshadefx::hash128 source_hash = reshadefx::hash(attributes);
 
 	effect &effect = _effects[effect_index];
 	const std::string effect_name = source_file.filename().u8string();
@@ -1240,7 +1295,7 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 		effect.source_hash = source_hash;
 	}
 
-	if (_effect_load_skipping && !_load_option_disable_skipping && !_worker_threads.empty()) // Only skip during 'load_effects'
+	if (_effect_load_skipping && !_load_option_disable_skipping && is_loading()) // Only skip during 'load_effects'
 	{
 		if (std::vector<std::string> techniques;
 			preset.get({}, "Techniques", techniques))
@@ -1261,8 +1316,8 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 	bool skip_optimization = false;
 	std::string pragma_warnings;
 
-	bool source_cached = false; std::string source;
-	if (!effect.preprocessed && (preprocess_required || (source_cached = load_effect_cache(source_file.stem().u8string() + '-' + std::to_string(_renderer_id) + '-' + std::to_string(source_hash), "i", source)) == false))
+	bool source_loaded_from_cache = false; std::string source; reshadefx::hash128 source_content_hash;
+	if (!effect.preprocessed && (preprocess_required || (source_loaded_from_cache = load_effect_cache(source_file.stem().u8string() + '-' + std::to_string(_renderer_id) + '-' + source_hash.to_string(), "i", source)) == false))
 	{
 		reshadefx::preprocessor pp;
 		pp.add_macro_definition("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
@@ -1293,8 +1348,13 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 				pp.add_macro_definition(definition);
 		}
 
-		for (const std::filesystem::path &include_path : include_paths)
+		for (const std::filesystem::path &include_path : additional_include_paths)
 			pp.add_include_path(include_path);
+		for (const std::filesystem::path &include_path : include_snapshot.include_paths)
+			pp.add_include_path(include_path);
+
+		// Share included files between all effects, so that common headers are only read once
+		pp.set_include_cache(_effect_include_cache);
 
 		// Add some conversion macros for compatibility with older versions of ReShade
 		pp.append_string(
@@ -1315,6 +1375,7 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 
 		if (effect.preprocessed)
 		{
+			source_content_hash = pp.output_hash();
 			source = std::move(pp.output());
 
 			for (const auto &pragma : pp.used_pragmas())
@@ -1338,7 +1399,7 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 
 			// Do not cache if any pragma commands were used, to ensure they are read again next time
 			if (pp.used_pragmas().empty())
-				source_cached = save_effect_cache(source_file.stem().u8string() + '-' + std::to_string(_renderer_id) + '-' + std::to_string(source_hash), "i", source);
+				save_effect_cache(source_file.stem().u8string() + '-' + std::to_string(_renderer_id) + '-' + source_hash.to_string(), "i", source);
 
 			// Keep track of used preprocessor definitions (so they can be displayed in the overlay)
 			effect.definitions.clear();
@@ -1372,24 +1433,61 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 		else
 			shader_model = 51; // D3D12
 
-		std::unique_ptr<reshadefx::codegen> codegen;
-		if ((_renderer_id & 0xF0000) == 0)
-			codegen.reset(reshadefx::create_codegen_hlsl(shader_model, !_no_debug_info, _performance_mode));
-		else if (_renderer_id < 0x20000)
-			codegen.reset(reshadefx::create_codegen_glsl(false, !_no_debug_info, _performance_mode, false, true));
-		else // Vulkan uses SPIR-V input
-			codegen.reset(reshadefx::create_codegen_spirv(true, !_no_debug_info, _performance_mode, false, false));
+		// Pre-processed source code that was loaded from the cache still needs to be hashed (freshly pre-processed code was hashed while it was written)
+		if (source_loaded_from_cache)
+			source_content_hash = reshadefx::hash(source);
+
+		// The compiled module only depends on the pre-processed source code and code generation options, so is identified by their content rather than the effect attributes
+		// This way it is found again even if unrelated attributes changed (e.g. the ReShade version, as long as code generation stayed the same), which skips parsing and code generation entirely
+		reshadefx::hasher module_hasher;
+		module_hasher.update("codegen_version=" + std::to_string(reshadefx::codegen_version) + ';');
+		module_hasher.update("shader_model=" + std::to_string(shader_model) + ';');
+		module_hasher.update("debug_info=" + std::string(_no_debug_info ? "0" : "1") + ';');
+		module_hasher.update("performance_mode=" + std::string(_performance_mode ? "1" : "0") + ';');
+		module_hasher.update("optimize=" + std::string(skip_optimization ? "0" : "1") + ';'); // Set through a pragma, which is not part of the pre-processed source code
+		module_hasher.update(source_content_hash.to_string());
+		const std::string module_cache_id = source_file.stem().u8string() + '-' + std::to_string(_renderer_id) + '-' + module_hasher.finalize().to_string();
+
+		if (std::string module_data;
+			load_effect_cache(module_cache_id, "module", module_data) &&
+			reshadefx::deserialize_module(module_data.data(), module_data.size(), effect.module))
+		{
+			effect.compiled = true;
+		}
+		else
+		{
+			std::unique_ptr<reshadefx::codegen> codegen;
+			if ((_renderer_id & 0xF0000) == 0)
+				codegen.reset(reshadefx::create_codegen_hlsl(shader_model, !_no_debug_info, _performance_mode, !skip_optimization));
+			else if (_renderer_id < 0x20000)
+				codegen.reset(reshadefx::create_codegen_glsl(false, !_no_debug_info, _performance_mode, false, true, !skip_optimization));
+			else // Vulkan uses SPIR-V input
+				codegen.reset(reshadefx::create_codegen_spirv(true, !_no_debug_info, _performance_mode, false, false, !skip_optimization));
+
+			reshadefx::parser parser;
 
-		reshadefx::parser parser;
+			// Compile the pre-processed source code (try the compile even if the preprocessor step failed to get additional error information)
+			effect.compiled = parser.parse(source, codegen.get());
 
-		// Compile the pre-processed source code (try the compile even if the preprocessor step failed to get additional error information)
-		effect.compiled = parser.parse(std::move(source), codegen.get());
+			// Append parser errors to the error list
+			effect.errors  += parser.errors();
 
-		// Append parser errors to the error list
-		effect.errors  += parser.errors();
+			// Write result to effect module (including separate code for every entry point, so that the shader compiler only has to process the functions each of them actually references)
+			// Spread that work across the worker threads that are not busy loading other effects (e.g. all of them when only a single effect is reloaded)
+			codegen->write_result(effect.module, true, [this](size_t count, const std::function<void(size_t)> &func) { _worker_pool->parallel_for(count, func); });
 
-		// Write result to effect module
-		codegen->write_result(effect.module);
+			if (const unsigned int eliminated_texture_fetches = codegen->eliminated_texture_fetches(), eliminated_uniform_loads = codegen->eliminated_uniform_loads();
+				eliminated_texture_fetches != 0 || eliminated_uniform_loads != 0)
+				LOG(DEBUG) << "Eliminated " << eliminated_texture_fetches << " redundant texture fetches and " << eliminated_uniform_loads << " redundant uniform loads in " << source_file << '.';
+
+			// Only cache modules that compiled without any warnings, so that those are reported again next time
+			if (effect.compiled && parser.errors().empty())
+			{
+				module_data.clear();
+				reshadefx::serialize_module(effect.module, module_data);
+				save_effect_cache(module_cache_id, "module", module_data);
+			}
+		}
 
 		if (effect.compiled)
 		{
@@ -1500,11 +1598,13 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 				}
 
 				effect.module.hlsl = preamble + effect.module.hlsl;
+				for (reshadefx::entry_point &entry_point : effect.module.entry_points)
+					entry_point.hlsl = preamble + entry_point.hlsl;
 			}
 		}
 	}
 
-	if ( effect.compiled && (effect.preprocessed || source_cached))
+	if ( effect.compiled && (effect.preprocessed || source_loaded_from_cache))
 	{
 		// Compile shader modules
 		for (const reshadefx::entry_point &entry_point : effect.module.entry_points)
@@ -1516,7 +1616,20 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 				break;
 			}
 
-			auto &assembly = effect.assembly[entry_point.name];
+			// Create all entries up front, so that the map is not modified while entry points are compiled concurrently below
+			effect.assembly[entry_point.name];
+		}
+
+		// Entry points are independent of each other, so compile them in parallel (the back-end compiler dominates load time for effects with many passes)
+		// Errors are collected per entry point and merged afterwards, so that the output does not depend on the order in which compilation finished
+		std::vector<std::string> entry_point_errors(effect.module.entry_points.size());
+		std::atomic<bool> compile_failed = false;
+
+		const auto compile_entry_point = [&](size_t entry_point_index) {
+			const reshadefx::entry_point &entry_point = effect.module.entry_points[entry_point_index];
+			std::string &errors = entry_point_errors[entry_point_index];
+
+			auto &assembly = effect.assembly.at(entry_point.name);
 			std::string &cso = assembly.first;
 			std::string &cso_text = assembly.second;
 
@@ -1532,7 +1645,7 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 					"#define SV_DEPTH_PIXEL_SIZE DEPTH_PIXEL_SIZE\n"
 					"#define SV_TARGET_PIXEL_SIZE COLOR_PIXEL_SIZE\n"
 					"#line 1\n" + // Reset line number, so it matches what is shown when viewing the generated code
-					effect.module.hlsl;
+					entry_point.hlsl;
 
 				// Overwrite position semantic in pixel shaders
 				const D3D_SHADER_MACRO ps_defines[] = {
@@ -1593,9 +1706,12 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 				hlsl_attributes += "profile=" + profile + ';';
 				hlsl_attributes += "flags=" + std::to_string(compile_flags) + ';';
 
+				reshadefx::hasher hlsl_hasher;
+				hlsl_hasher.update(hlsl_attributes);
+				hlsl_hasher.update(hlsl);
+
 				const std::string cache_id =
-					effect.source_file.stem().u8string() + '-' + entry_point.name + '-' + std::to_string(_renderer_id) + '-' +
-					std::to_string(std::hash<std::string_view>()(hlsl_attributes) ^ std::hash<std::string_view>()(hlsl));
+					effect.source_file.stem().u8string() + '-' + entry_point.name + '-' + std::to_string(_renderer_id) + '-' + hlsl_hasher.finalize().to_string();
 
 				if (!load_effect_cache(cache_id, "cso", cso))
 				{
@@ -1640,15 +1756,12 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 						}
 					}
 
-					effect.errors += d3d_errors_string;
+					errors += d3d_errors_string;
 
 					if (FAILED(hr))
 					{
-						effect.compiled = false;
-
-						d3d_errors.reset();
-						d3d_compiled.reset();
-						break;
+						compile_failed = true;
+						return;
 					}
 
 					cso.resize(d3d_compiled->GetBufferSize());
@@ -1656,17 +1769,6 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 
 					save_effect_cache(cache_id, "cso", cso);
 				}
-
-				if (!load_effect_cache(cache_id, "asm", cso_text))
-				{
-					const auto D3DDisassemble = reinterpret_cast<pD3DDisassemble>(GetProcAddress(static_cast<HMODULE>(_d3d_compiler_module), "D3DDisassemble"));
-					assert(D3DDisassemble != nullptr);
-
-					if (com_ptr<ID3DBlob> d3d_disassembled; SUCCEEDED(D3DDisassemble(cso.data(), cso.size(), 0, nullptr, &d3d_disassembled)))
-						cso_text.assign(static_cast<const char *>(d3d_disassembled->GetBufferPointer()), d3d_disassembled->GetBufferSize() - 1);
-
-					save_effect_cache(cache_id, "asm", cso_text);
-				}
 			}
 			else if (effect.module.spirv.empty())
 			{
@@ -1700,7 +1802,7 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 				}
 
 				cso += "#line 1 0\n"; // Reset line number, so it matches what is shown when viewing the generated code
-				cso += effect.module.hlsl;
+				cso += entry_point.hlsl;
 
 				cso_text = cso;
 			}
@@ -1710,79 +1812,21 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 
 				// There are various issues with SPIR-V modules that have multiple entry points on all major GPU vendors.
 				// On AMD for instance creating a graphics pipeline just fails with a generic VK_ERROR_OUT_OF_HOST_MEMORY. On NVIDIA artifacts occur on some driver versions.
-				// To work around these problems, create a separate shader module for every entry point and rewrite the SPIR-V module for each to remove all but a single entry point (and associated functions/variables).
-				uint32_t current_function = 0, current_function_offset = 0;
-				std::vector<uint32_t> spirv = effect.module.spirv; // Copy SPIR-V, so that all but the current entry point are only removed from that copy
-				std::vector<uint32_t> functions_to_remove, variables_to_remove;
-
-				for (uint32_t inst = 5 /* Skip SPIR-V header information */; inst < spirv.size();)
-				{
-					const uint32_t op = spirv[inst] & 0xFFFF;
-					const uint32_t len = (spirv[inst] >> 16) & 0xFFFF;
-					assert(len != 0);
-
-					switch (op)
-					{
-					case 15 /* OpEntryPoint */:
-						// Look for any non-matching entry points
-						if (entry_point.name != reinterpret_cast<const char *>(&spirv[inst + 3]))
-						{
-							functions_to_remove.push_back(spirv[inst + 2]);
-
-							// Get interface variables
-							for (uint32_t k = inst + 3 + static_cast<uint32_t>((strlen(reinterpret_cast<const char *>(&spirv[inst + 3])) + 4) / 4); k < inst + len; ++k)
-								variables_to_remove.push_back(spirv[k]);
-
-							// Remove this entry point from the module
-							spirv.erase(spirv.begin() + inst, spirv.begin() + inst + len);
-							continue;
-						}
-						break;
-					case 16 /* OpExecutionMode */:
-						if (std::find(functions_to_remove.begin(), functions_to_remove.end(), spirv[inst + 1]) != functions_to_remove.end())
-						{
-							spirv.erase(spirv.begin() + inst, spirv.begin() + inst + len);
-							continue;
-						}
-						break;
-					case 59 /* OpVariable */:
-						// Remove all declarations of the interface variables for non-matching entry points
-						if (std::find(variables_to_remove.begin(), variables_to_remove.end(), spirv[inst + 2]) != variables_to_remove.end())
-						{
-							spirv.erase(spirv.begin() + inst, spirv.begin() + inst + len);
-							continue;
-						}
-						break;
-					case 71 /* OpDecorate */:
-						// Remove all decorations targeting any of the interface variables for non-matching entry points
-						if (std::find(variables_to_remove.begin(), variables_to_remove.end(), spirv[inst + 1]) != variables_to_remove.end())
-						{
-							spirv.erase(spirv.begin() + inst, spirv.begin() + inst + len);
-							continue;
-						}
-						break;
-					case 54 /* OpFunction */:
-						current_function = spirv[inst + 2];
-						current_function_offset = inst;
-						break;
-					case 56 /* OpFunctionEnd */:
-						// Remove all function definitions for non-matching entry points
-						if (std::find(functions_to_remove.begin(), functions_to_remove.end(), current_function) != functions_to_remove.end())
-						{
-							spirv.erase(spirv.begin() + current_function_offset, spirv.begin() + inst + len);
-							inst = current_function_offset;
-							continue;
-						}
-						break;
-					}
-
-					inst += len;
-				}
+				// To work around these problems, use the separate SPIR-V module for every entry point, which only contains that entry point (and associated functions/variables).
+				const std::vector<uint32_t> &spirv = entry_point.spirv;
 
 				cso.resize(spirv.size() * sizeof(uint32_t));
 				std::memcpy(cso.data(), spirv.data(), cso.size());
 			}
-		}
+		};
+
+		if (effect.compiled)
+			_worker_pool->parallel_for(effect.module.entry_points.size(), compile_entry_point);
+
+		for (const std::string &errors : entry_point_errors)
+			effect.errors += errors;
+		if (compile_failed)
+			effect.compiled = false;
 
 		const std::unique_lock<std::shared_mutex> lock(_reload_mutex);
 
@@ -1904,7 +1948,7 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 	else
 		_reload_remaining_effects = 0; // Force effect initialization in 'update_effects'
 
-	if ( effect.compiled && (effect.preprocessed || source_cached))
+	if ( effect.compiled && (effect.preprocessed || source_loaded_from_cache))
 	{
 		if (effect.errors.empty())
 			LOG(INFO) << "Successfully compiled " << source_file << '.';
@@ -2846,23 +2890,61 @@ void reshade::runtime::load_effects()
 		}
 	}
 
+	// Create include cache before any threads are spawned, it is kept alive across reloads and only re-reads files that were modified
+	if (_effect_include_cache == nullptr)
+		_effect_include_cache = std::make_shared<reshadefx::include_cache>();
+
+	// Open effect cache before any threads are spawned (or again in case the cache path was changed since the last reload)
+	if (const std::filesystem::path cache_path = g_reshade_base_path / _intermediate_cache_path / L"reshade-cache.bin";
+		!_no_effect_cache && (_effect_cache == nullptr || _effect_cache->path() != cache_path))
+	{
+		_effect_cache = packed_cache::open(cache_path);
+		if (_effect_cache == nullptr)
+			LOG(WARN) << "Failed to open effect cache file " << cache_path << '.';
+	}
+	if (_effect_cache != nullptr)
+		_effect_cache->set_size_limit(static_cast<uint64_t>(_effect_cache_size_limit) * 1024 * 1024);
+
+	// Scan include directories only once for all effects, rather than every effect doing so again to build its cache key
+	const std::shared_ptr<const effect_include_snapshot> include_snapshot = create_include_snapshot(_effect_search_paths);
+
 	// Allocate space for effects which are placed in this array during the 'load_effect' call
 	const size_t offset = _effects.size();
 	_effects.resize(offset + effect_files.size());
 	_reload_remaining_effects = effect_files.size();
+	_reload_total_load_duration = 0;
+	_reload_start_time = std::chrono::high_resolution_clock::now();
 
 	// Now that we have a list of files, load them in parallel
-	// Split workload into batches instead of launching a thread for every file to avoid launch overhead and stutters due to too many threads being in flight
-	const size_t num_splits = std::min<size_t>(effect_files.size(), std::max<size_t>(std::thread::hardware_concurrency(), 2u) - 1);
+	// Every effect is a separate task, so that idle workers keep picking up the next one, instead of a fixed batch of effects being assigned to each thread up front
+	for (size_t i = 0; i < effect_files.size(); ++i)
+	{
+		// Compile time varies a lot between effects, so start with those that took longest last time, to avoid a single expensive effect being started last and holding up the entire reload
+		// Effects that were not loaded before likely need a full compile without any cache hits, so order them before all others (by file size, as a rough estimate of their complexity)
+		uint64_t estimated_cost = 0;
+		if (const auto it = _effect_load_durations.find(effect_files[i].native()); it != _effect_load_durations.end())
+			estimated_cost = it->second;
+		else
+		{
+			std::error_code ec;
+			const uintmax_t file_size = std::filesystem::file_size(effect_files[i], ec);
+			estimated_cost = (1ull << 63) | (ec ? 0 : file_size);
+		}
 
-	// Keep track of the spawned threads, so the runtime cannot be destroyed while they are still running
-	for (size_t n = 0; n < num_splits; ++n)
-		_worker_threads.emplace_back([this, effect_files, offset, num_splits, n, &preset]() {
+		_worker_pool->submit([this, source_file = effect_files[i], effect_index = offset + i, &preset, include_snapshot]() {
 			// Abort loading when initialization state changes (indicating that 'on_reset' was called in the meantime)
-			for (size_t i = 0; i < effect_files.size() && _is_initialized; ++i)
-				if (i * num_splits / effect_files.size() == n)
-					load_effect(effect_files[i], preset, offset + i);
-		});
+			if (!_is_initialized)
+				return;
+
+			const std::chrono::high_resolution_clock::time_point time_load_started = std::chrono::high_resolution_clock::now();
+			load_effect(source_file, preset, *include_snapshot, effect_index);
+			const std::chrono::high_resolution_clock::time_point time_load_finished = std::chrono::high_resolution_clock::now();
+
+			const uint64_t load_duration = std::chrono::duration_cast<std::chrono::nanoseconds>(time_load_finished - time_load_started).count();
+			_effects[effect_index].load_duration = load_duration;
+			_reload_total_load_duration += load_duration;
+		}, estimated_cost);
+	}
 }
 void reshade::runtime::load_textures()
 {
@@ -2929,7 +3011,7 @@ bool reshade::runtime::reload_effect(size_t effect_index, bool preprocess_requir
 
 	const std::filesystem::path source_file = _effects[effect_index].source_file;
 	destroy_effect(effect_index);
-	return load_effect(source_file, ini_file::load_cache(_current_preset_path), effect_index, preprocess_required);
+	return load_effect(source_file, ini_file::load_cache(_current_preset_path), *create_include_snapshot(_effect_search_paths), effect_index, preprocess_required);
 }
 void reshade::runtime::reload_effects()
 {
@@ -2947,10 +3029,7 @@ void reshade::runtime::reload_effects()
 void reshade::runtime::destroy_effects()
 {
 	// Make sure no threads are still accessing effect data
-	for (std::thread &thread : _worker_threads)
-		if (thread.joinable())
-			thread.join();
-	_worker_threads.clear();
+	_worker_pool->wait();
 
 	for (size_t effect_index = 0; effect_index < _effects.size(); ++effect_index)
 		destroy_effect(effect_index);
@@ -2979,44 +3058,28 @@ void reshade::runtime::destroy_effects()
 
 bool reshade::runtime::load_effect_cache(const std::string &id, const std::string &type, std::string &data) const
 {
-	if (_no_effect_cache)
+	if (_no_effect_cache || _effect_cache == nullptr)
 		return false;
 
-	std::filesystem::path path = g_reshade_base_path / _intermediate_cache_path;
-	path /= std::filesystem::u8path("reshade-" + id + '.' + type);
-
-	{	const HANDLE file = CreateFileW(path.c_str(), FILE_GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
-		if (file == INVALID_HANDLE_VALUE)
-			return false;
-		DWORD size = GetFileSize(file, nullptr);
-		data.resize(size);
-		const BOOL result = ReadFile(file, data.data(), size, &size, nullptr);
-		CloseHandle(file);
-		return result != FALSE;
-	}
+	return _effect_cache->load(id + '.' + type, data);
 }
 bool reshade::runtime::save_effect_cache(const std::string &id, const std::string &type, const std::string &data) const
 {
-	if (_no_effect_cache)
+	if (_no_effect_cache || _effect_cache == nullptr)
 		return false;
 
-	std::filesystem::path path = g_reshade_base_path / _intermediate_cache_path;
-	path /= std::filesystem::u8path("reshade-" + id + '.' + type);
-
-	{	const HANDLE file = CreateFileW(path.c_str(), FILE_GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_NEW, FILE_ATTRIBUTE_ARCHIVE | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
-		if (file == INVALID_HANDLE_VALUE)
-			return false;
-		DWORD size = static_cast<DWORD>(data.size());
-		const BOOL result = WriteFile(file, data.data(), size, &size, nullptr);
-		CloseHandle(file);
-		return result != FALSE;
-	}
+	return _effect_cache->save(id + '.' + type, data);
 }
 void reshade::runtime::clear_effect_cache()
 {
+	if (_effect_cache != nullptr)
+		_effect_cache->clear();
+	if (_effect_include_cache != nullptr)
+		_effect_include_cache->clear();
+
 	std::error_code ec;
 
-	// Find all cached effect files and delete them
+	// Find all cached effect files written by older versions (which stored every entry in a separate file) and delete them
 	for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(g_reshade_base_path / _intermediate_cache_path, std::filesystem::directory_options::skip_permission_denied, ec))
 	{
 		if (entry.is_directory(ec))
@@ -3024,13 +3087,32 @@ void reshade::runtime::clear_effect_cache()
 
 		const std::filesystem::path filename = entry.path().filename();
 		const std::filesystem::path extension = entry.path().extension();
-		if (filename.native().compare(0, 8, L"reshade-") != 0 || (extension != L".i" && extension != L".cso" && extension != L".asm"))
+		if (filename.native().compare(0, 8, L"reshade-") != 0 || (extension != L".i" && extension != L".module" && extension != L".cso" && extension != L".asm"))
 			continue;
 
 		std::filesystem::remove(entry, ec);
 	}
 }
 
+void reshade::runtime::disassemble_entry_point(effect &effect, const std::string &entry_point_name)
+{
+	auto &assembly = effect.assembly.at(entry_point_name);
+	const std::string &cso = assembly.first;
+	std::string &cso_text = assembly.second;
+
+	// Only HLSL bytecode needs disassembling (GLSL is kept as text already), and only once, since it is not modified until the effect is reloaded
+	if ((_renderer_id & 0xF0000) != 0 || cso.empty() || !cso_text.empty())
+		return;
+
+	assert(_d3d_compiler_module != nullptr);
+
+	const auto D3DDisassemble = reinterpret_cast<pD3DDisassemble>(GetProcAddress(static_cast<HMODULE>(_d3d_compiler_module), "D3DDisassemble"));
+	assert(D3DDisassemble != nullptr);
+
+	if (com_ptr<ID3DBlob> d3d_disassembled; SUCCEEDED(D3DDisassemble(cso.data(), cso.size(), 0, nullptr, &d3d_disassembled)))
+		cso_text.assign(static_cast<const char *>(d3d_disassembled->GetBufferPointer()), d3d_disassembled->GetBufferSize() - 1);
+}
+
 bool reshade::runtime::update_effect_color_tex(api::format format)
 {
 	assert(format != api::format::unknown);
@@ -3119,11 +3201,8 @@ void reshade::runtime::update_effects()
 
 	if (_reload_remaining_effects == 0)
 	{
-		// Clear the thread list now that they all have finished
-		for (std::thread &thread : _worker_threads)
-			if (thread.joinable())
-				thread.join(); // Threads have exited, but still need to join them prior to destruction
-		_worker_threads.clear();
+		// All effects have been loaded, but the tasks may still be finishing up, so wait for them before accessing effect data
+		_worker_pool->wait();
 
 		// Finished loading effects, so apply preset to figure out which ones need compiling
 		load_current_preset();
@@ -3131,6 +3210,38 @@ void reshade::runtime::update_effects()
 		_last_reload_time = std::chrono::high_resolution_clock::now();
 		_reload_remaining_effects = std::numeric_limits<size_t>::max();
 
+		// Get rid of stale and least recently used cache entries in the background, now that no effects are being compiled anymore
+		// This uses a separate thread, so that waiting for effect loading to finish on the render thread does not wait for the compaction too
+		if (_effect_cache != nullptr)
+		{
+			if (_effect_cache_worker == nullptr)
+				_effect_cache_worker = std::make_unique<worker_pool>(1);
+
+			_effect_cache_worker->submit([effect_cache = _effect_cache]() { effect_cache->compact(); });
+		}
+
+		// Remember how long each effect took to load, to schedule the most expensive ones first during the next reload
+		for (const effect &effect : _effects)
+			if (effect.load_duration != 0)
+				_effect_load_durations[effect.source_file.native()] = effect.load_duration;
+
+		// Reloading a single effect also ends up here, but only a full reload through 'load_effects' sets the start time
+		if (_reload_start_time != std::chrono::high_resolution_clock::time_point())
+		{
+			_last_reload_duration = _last_reload_time - _reload_start_time;
+			_last_reload_total_load_duration = std::chrono::nanoseconds(_reload_total_load_duration.load());
+			_reload_start_time = {};
+
+			LOG(INFO) << "Loaded " << _effects.size() << " effects in " << std::chrono::duration_cast<std::chrono::milliseconds>(_last_reload_duration).count() << " ms (with " << std::chrono::duration_cast<std::chrono::milliseconds>(_last_reload_total_load_duration).count() << " ms of work spread across " << _worker_pool->num_threads() << " threads).";
+
+			// Drop included files that none of the effects of this reload referenced anymore (e.g. because effects or search paths were removed), so that the cache does not keep growing over the lifetime of the process
+			if (_effect_include_cache != nullptr)
+				_effect_include_cache->evict_unused();
+		}
+
+		if (_effect_include_cache != nullptr)
+			LOG(INFO) << "Include cache has served " << _effect_include_cache->hits() << " includes from memory and read " << _effect_include_cache->misses() << " files from disk so far.";
+
 		// Reset all effect loading options
 		_load_option_disable_skipping = false;
 
@@ -3723,7 +3834,10 @@ void reshade::runtime::save_texture(const texture &tex)
 	if (std::vector<uint8_t> data(static_cast<size_t>(tex.width) * static_cast<size_t>(tex.height * 4));
 		get_texture_data(tex.resource, api::resource_usage::shader_resource, data.data()))
 	{
-		_worker_threads.emplace_back([this, screenshot_path, data = std::move(data), width = tex.width, height = tex.height]() mutable {
+		if (_screenshot_worker == nullptr)
+			_screenshot_worker = std::make_unique<worker_pool>(1);
+
+		_screenshot_worker->submit([this, screenshot_path, data = std::move(data), width = tex.width, height = tex.height]() mutable {
 			// Default to a save failure unless it is reported to succeed below
 			bool save_success = false;
 
@@ -4188,7 +4302,10 @@ void reshade::runtime::save_screenshot(const std::string &postfix)
 		const bool include_preset = false;
 #endif
 
-		_worker_threads.emplace_back([this, screenshot_path, data = std::move(data), include_preset]() mutable {
+		if (_screenshot_worker == nullptr)
+			_screenshot_worker = std::make_unique<worker_pool>(1);
+
+		_screenshot_worker->submit([this, screenshot_path, data = std::move(data), include_preset]() mutable {
 			// Remove alpha channel
 			int comp = 4;
 			if (_screenshot_clear_alpha)
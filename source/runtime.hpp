@@ -20,6 +20,12 @@
 
 class ini_file;
 
+namespace reshadefx
+{
+	// Forward declarations to avoid excessive #include
+	class include_cache;
+}
+
 namespace reshade
 {
 	// Forward declarations to avoid excessive #include
@@ -27,6 +33,9 @@ namespace reshade
 	struct uniform;
 	struct texture;
 	struct technique;
+	struct effect_include_snapshot;
+	class packed_cache;
+	class worker_pool;
 
 	/// <summary>
 	/// The main ReShade post-processing effect runtime.
@@ -284,7 +293,7 @@ namespace reshade
 
 		bool switch_to_next_preset(std::filesystem::path filter_path, bool reversed = false);
 
-		bool load_effect(const std::filesystem::path &source_file, const ini_file &preset, size_t effect_index, bool preprocess_required = false);
+		bool load_effect(const std::filesystem::path &source_file, const ini_file &preset, const effect_include_snapshot &include_snapshot, size_t effect_index, bool preprocess_required = false);
 		bool create_effect(size_t effect_index);
 		bool create_effect_sampler_state(const api::sampler_desc &desc, api::sampler &sampler);
 		void destroy_effect(size_t effect_index);
@@ -305,6 +314,8 @@ namespace reshade
 		bool save_effect_cache(const std::string &id, const std::string &type, const std::string &data) const;
 		void clear_effect_cache();
 
+		void disassemble_entry_point(effect &effect, const std::string &entry_point_name);
+
 		bool update_effect_color_tex(api::format format);
 		bool update_effect_stencil_tex(api::format format);
 
@@ -374,6 +385,7 @@ namespace reshade
 		std::vector<std::string> _global_preprocessor_definitions;
 		std::vector<std::string> _preset_preprocessor_definitions;
 		std::filesystem::path _intermediate_cache_path;
+		unsigned int _effect_cache_size_limit = 512;
 		std::vector<std::filesystem::path> _effect_search_paths;
 		std::vector<std::filesystem::path> _texture_search_paths;
 
@@ -382,13 +394,21 @@ namespace reshade
 		std::shared_mutex _reload_mutex;
 		std::vector<size_t> _reload_create_queue;
 		std::atomic<size_t> _reload_remaining_effects = std::numeric_limits<size_t>::max();
+		std::shared_ptr<reshadefx::include_cache> _effect_include_cache;
+		std::shared_ptr<packed_cache> _effect_cache;
+		std::unique_ptr<worker_pool> _effect_cache_worker;
 		void *_d3d_compiler_module = nullptr;
 
 		std::vector<effect> _effects;
 		std::vector<texture> _textures;
 		std::vector<technique> _techniques;
+		std::unordered_map<std::wstring, uint64_t> _effect_load_durations;
+		std::atomic<uint64_t> _reload_total_load_duration = 0;
+		std::chrono::high_resolution_clock::time_point _reload_start_time;
+		std::chrono::nanoseconds _last_reload_duration = {};
+		std::chrono::nanoseconds _last_reload_total_load_duration = {};
 #endif
-		std::vector<std::thread> _worker_threads;
+		std::unique_ptr<worker_pool> _worker_pool;
 		std::chrono::high_resolution_clock::time_point _last_reload_time;
 		#pragma endregion
 
@@ -440,6 +460,7 @@ namespace reshade
 		bool _screenshot_directory_creation_successfull = true;
 		std::filesystem::path _last_screenshot_file;
 		std::chrono::high_resolution_clock::time_point _last_screenshot_time;
+		std::unique_ptr<worker_pool> _screenshot_worker;
 		#pragma endregion
 
 		#pragma region Preset Switching
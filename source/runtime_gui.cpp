@@ -1832,6 +1832,8 @@ void reshade::runtime::draw_gui_statistics()
 		ImGui::Text("Frame %llu:", _framecount + 1);
 #if RESHADE_FX
 		ImGui::TextUnformatted("Post-Processing:");
+		if (_last_reload_duration.count() != 0)
+			ImGui::TextUnformatted("Effect Loading:");
 #endif
 
 		ImGui::EndGroup();
@@ -1871,6 +1873,8 @@ void reshade::runtime::draw_gui_statistics()
 		ImGui::Text("%.2f fps", _imgui_context->IO.Framerate);
 #if RESHADE_FX
 		ImGui::Text("%*.3f ms CPU", cpu_digits + 4, post_processing_time_cpu * 1e-6f);
+		if (_last_reload_duration.count() != 0)
+			ImGui::Text("%.0f ms", _last_reload_duration.count() * 1e-6f);
 #endif
 
 		ImGui::EndGroup();
@@ -1888,6 +1892,11 @@ void reshade::runtime::draw_gui_statistics()
 #if RESHADE_FX
 		if (_gather_gpu_statistics && post_processing_time_gpu != 0)
 			ImGui::Text("%*.3f ms GPU", gpu_digits + 4, (post_processing_time_gpu * 1e-6f));
+		else if (_last_reload_duration.count() != 0)
+			ImGui::NewLine(); // Keep next line aligned with the other columns
+		// Ratio between the time it would have taken to load all effects one after another and the time it actually took with all worker threads
+		if (_last_reload_duration.count() != 0)
+			ImGui::Text("%.2fx speedup", static_cast<double>(_last_reload_total_load_duration.count()) / _last_reload_duration.count());
 #endif
 
 		ImGui::EndGroup();
@@ -3415,10 +3424,14 @@ void reshade::runtime::open_code_editor(size_t effect_index, const std::filesyst
 }
 void reshade::runtime::open_code_editor(editor_instance &instance)
 {
-	const effect &effect = _effects[instance.effect_index];
+	effect &effect = _effects[instance.effect_index];
 
 	if (!instance.entry_point_name.empty())
 	{
+		// Disassembly is only generated on demand, since it is rarely looked at and would otherwise slow down every effect compilation
+		if (instance.entry_point_name != "Generated code")
+			disassemble_entry_point(effect, instance.entry_point_name);
+
 		instance.editor.set_text(instance.entry_point_name == "Generated code" ?
 			effect.module.hlsl : effect.assembly.at(instance.entry_point_name).second);
 		instance.editor.set_readonly(true);
@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "effect_hash.hpp"
 #include "effect_module.hpp"
 
 namespace reshade
@@ -243,6 +244,25 @@ namespace reshade
 		uint32_t query_base_index = 0;
 	};
 
+	/// <summary>
+	/// State of all effect include directories, captured once per reload and shared by all effects loaded during it.
+	/// </summary>
+	struct effect_include_snapshot
+	{
+		/// <summary>
+		/// Sorted list of all include directories (the effect search paths, with recursive ones expanded to every sub-directory).
+		/// </summary>
+		std::vector<std::filesystem::path> include_paths;
+		/// <summary>
+		/// Last write time of every effect file in the include directories, keyed by full path.
+		/// </summary>
+		std::unordered_map<std::wstring, int64_t> effect_file_times;
+		/// <summary>
+		/// Hash of the include directory names and the names and last write times of all headers in them, which changes whenever any header is added, removed or modified.
+		/// </summary>
+		reshadefx::hash128 fingerprint;
+	};
+
 	struct effect
 	{
 		unsigned int rendering = 0;
@@ -251,7 +271,8 @@ namespace reshade
 		bool preprocessed = false;
 		std::string errors;
 		reshadefx::module module;
-		size_t source_hash = 0;
+		reshadefx::hash128 source_hash;
+		uint64_t load_duration = 0;
 		std::filesystem::path source_file;
 		std::vector<std::filesystem::path> included_files;
 		std::vector<std::pair<std::string, std::string>> definitions;
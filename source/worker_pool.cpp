@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause OR MIT
+ */
+
+#include "worker_pool.hpp"
+#include <atomic>
+#include <limits>
+#include <algorithm>
+
+reshade::worker_pool::worker_pool(unsigned int num_threads) :
+	_num_threads(num_threads != 0 ? num_threads : std::max(std::thread::hardware_concurrency(), 2u) - 1)
+{
+}
+reshade::worker_pool::~worker_pool()
+{
+	// Finish all outstanding work before shutting down, since tasks may hold references to objects that expect them to run
+	wait();
+
+	{	const std::lock_guard<std::mutex> lock(_mutex);
+		_exit = true;
+	}
+
+	_task_available.notify_all();
+
+	for (std::thread &thread : _threads)
+		thread.join();
+}
+
+void reshade::worker_pool::submit(std::function<void()> func, uint64_t estimated_cost)
+{
+	{	const std::lock_guard<std::mutex> lock(_mutex);
+
+		// Launch worker threads lazily, so that a pool that is never used does not cost anything
+		if (_threads.empty())
+		{
+			_threads.reserve(_num_threads);
+			for (unsigned int i = 0; i < _num_threads; ++i)
+				_threads.emplace_back(&worker_pool::worker_main, this);
+		}
+
+		_queue.push({ estimated_cost, _next_sequence++, std::move(func) });
+	}
+
+	_task_available.notify_one();
+}
+
+void reshade::worker_pool::parallel_for(size_t count, const std::function<void(size_t)> &func)
+{
+	if (count == 0)
+		return;
+
+	// Helper tasks may only start executing after this call returned, in which case they find no work left, so keep the shared state alive until then
+	struct parallel_for_state
+	{
+		const std::function<void(size_t)> *func;
+		size_t count;
+		std::atomic<size_t> next_index = 0;
+		std::atomic<size_t> num_finished = 0;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+
+	const auto state = std::make_shared<parallel_for_state>();
+	state->func = &func;
+	state->count = count;
+
+	const auto process = [](parallel_for_state &state) {
+		for (size_t index; (index = state.next_index++) < state.count;)
+		{
+			(*state.func)(index);
+
+			if (++state.num_finished == state.count)
+			{
+				const std::lock_guard<std::mutex> lock(state.mutex);
+				state.finished.notify_all();
+			}
+		}
+	};
+
+	// Calling thread takes care of one index, so only need helpers for the rest
+	// These are queued before anything else, since the calling thread is waiting on them and would hold up all work depending on it otherwise
+	for (size_t i = 1; i < std::min<size_t>(count, static_cast<size_t>(_num_threads) + 1); ++i)
+		submit([state, process]() { process(*state); }, std::numeric_limits<uint64_t>::max());
+
+	process(*state);
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state]() { return state->num_finished == state->count; });
+}
+
+void reshade::worker_pool::wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_tasks_finished.wait(lock, [this]() { return _queue.empty() && _num_active_tasks == 0; });
+}
+
+bool reshade::worker_pool::is_idle()
+{
+	const std::lock_guard<std::mutex> lock(_mutex);
+	return _queue.empty() && _num_active_tasks == 0;
+}
+
+void reshade::worker_pool::worker_main()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (true)
+	{
+		_task_available.wait(lock, [this]() { return _exit || !_queue.empty(); });
+		if (_queue.empty())
+			break; // Only exit once all queued tasks were executed
+
+		// Cannot move out of the priority queue directly, since 'top' only returns a constant reference
+		std::function<void()> func = std::move(const_cast<task &>(_queue.top()).func);
+		_queue.pop();
+		_num_active_tasks++;
+
+		lock.unlock();
+		func();
+		func = nullptr; // Destroy captured state before reporting the task as finished
+		lock.lock();
+
+		if (--_num_active_tasks == 0 && _queue.empty())
+			_tasks_finished.notify_all();
+	}
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause OR MIT
+ */
+
+#pragma once
+
+#include <queue>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace reshade
+{
+	/// <summary>
+	/// A persistent set of worker threads that execute submitted tasks from a shared queue.
+	/// Tasks with a higher estimated cost are started first, so that expensive work does not end up being the last to run while all other workers are already idle.
+	/// </summary>
+	class worker_pool
+	{
+	public:
+		/// <summary>
+		/// Creates a new pool. The worker threads are only launched when the first task is submitted.
+		/// </summary>
+		/// <param name="num_threads">Number of worker threads, or zero to use one less than the number of cores (so that the render thread is left alone).</param>
+		explicit worker_pool(unsigned int num_threads = 0);
+		~worker_pool();
+
+		worker_pool(const worker_pool &) = delete;
+		worker_pool &operator=(const worker_pool &) = delete;
+
+		/// <summary>
+		/// Gets the number of worker threads tasks are distributed across.
+		/// </summary>
+		unsigned int num_threads() const { return _num_threads; }
+
+		/// <summary>
+		/// Adds a task to the queue, to be executed on one of the worker threads.
+		/// </summary>
+		/// <param name="task">Function to execute.</param>
+		/// <param name="estimated_cost">Arbitrary value used to order tasks, those with a higher cost are started before those with a lower one (tasks with equal cost are started in submission order).</param>
+		void submit(std::function<void()> task, uint64_t estimated_cost = 0);
+
+		/// <summary>
+		/// Calls a function for every index in the specified range, distributed across idle worker threads, and blocks until all calls have finished.
+		/// The calling thread processes indices itself too rather than just waiting, so this may safely be called from within a task (even when there are no idle worker threads).
+		/// </summary>
+		/// <param name="count">Number of indices to call the function for.</param>
+		/// <param name="func">Function that is called with every index from zero to <paramref name="count"/> minus one.</param>
+		void parallel_for(size_t count, const std::function<void(size_t)> &func);
+
+		/// <summary>
+		/// Blocks the calling thread until all submitted tasks have finished executing.
+		/// </summary>
+		void wait();
+
+		/// <summary>
+		/// Checks whether there are no tasks queued or executing.
+		/// </summary>
+		bool is_idle();
+
+	private:
+		struct task
+		{
+			uint64_t estimated_cost;
+			uint64_t sequence;
+			std::function<void()> func;
+
+			bool operator<(const task &other) const
+			{
+				// Priority queue pops the largest element, so order by cost and then by reverse submission order
+				return estimated_cost != other.estimated_cost ? estimated_cost < other.estimated_cost : sequence > other.sequence;
+			}
+		};
+
+		void worker_main();
+
+		const unsigned int _num_threads;
+		std::vector<std::thread> _threads;
+		std::mutex _mutex;
+		std::condition_variable _task_available;
+		std::condition_variable _tasks_finished;
+		std::priority_queue<task> _queue;
+		uint64_t _next_sequence = 0;
+		size_t _num_active_tasks = 0;
+		bool _exit = false;
+	};
+}
@@ -35,8 +35,11 @@ Options:
   --height <value>          Value of the 'BUFFER_HEIGHT' preprocessor macro.
   --invert-y                Insert code to invert the Y component of the output position in vertex shaders (only applies to SPIR-V).
   --spec-constants          Convert uniform variables to specialization constants.
+  --split-entry-points      Generate separate code for every entry point and print its size compared to the whole module.
+  --statistics              Print the number of redundant texture fetches, uniform loads and other operations that were eliminated (and the number of generated SPIR-V instructions).
   --vulkan-semantics        Generate GLSL/SPIR-V code under Vulkan semantics, instead of OpenGL semantics.
 
+  -Od                       Disable optimizations.
   -Zi                       Enable debug information.
 	)", path);
 }
@@ -52,8 +55,11 @@ int main(int argc, char *argv[])
 	bool print_glsl = false;
 	bool print_hlsl = false;
 	bool debug_info = false;
+	bool optimize = true;
 	bool invert_y_axis = false;
 	bool spec_constants = false;
+	bool split_entry_points = false;
+	bool print_statistics = false;
 	bool vulkan_semantics = false;
 	unsigned int shader_model = 50;
 
@@ -95,6 +101,8 @@ int main(int argc, char *argv[])
 
 			if (0 == std::strcmp(arg, "-Zi"))
 				debug_info = true;
+			else if (0 == std::strcmp(arg, "-Od"))
+				optimize = false;
 			else if (0 == std::strcmp(arg, "--glsl"))
 				print_glsl = true;
 			else if (0 == std::strcmp(arg, "--hlsl"))
@@ -103,6 +111,10 @@ int main(int argc, char *argv[])
 				invert_y_axis = true;
 			else if (0 == std::strcmp(arg, "--spec-constants"))
 				spec_constants = true;
+			else if (0 == std::strcmp(arg, "--split-entry-points"))
+				split_entry_points = true;
+			else if (0 == std::strcmp(arg, "--statistics"))
+				print_statistics = true;
 			else if (0 == std::strcmp(arg, "--vulkan-semantics"))
 				vulkan_semantics = true;
 
@@ -164,11 +176,11 @@ int main(int argc, char *argv[])
 
 	std::unique_ptr<reshadefx::codegen> backend;
 	if (print_glsl)
-		backend.reset(reshadefx::create_codegen_glsl(vulkan_semantics, debug_info, spec_constants, invert_y_axis));
+		backend.reset(reshadefx::create_codegen_glsl(vulkan_semantics, debug_info, spec_constants, false, invert_y_axis, optimize));
 	else if (print_hlsl)
-		backend.reset(reshadefx::create_codegen_hlsl(shader_model, debug_info, spec_constants));
+		backend.reset(reshadefx::create_codegen_hlsl(shader_model, debug_info, spec_constants, optimize));
 	else
-		backend.reset(reshadefx::create_codegen_spirv(vulkan_semantics, debug_info, spec_constants, invert_y_axis));
+		backend.reset(reshadefx::create_codegen_spirv(vulkan_semantics, debug_info, spec_constants, false, invert_y_axis, optimize));
 
 	if (!parser.parse(pp.output(), backend.get()))
 	{
@@ -180,7 +192,34 @@ int main(int argc, char *argv[])
 	}
 
 	reshadefx::module module;
-	backend->write_result(module);
+	backend->write_result(module, split_entry_points);
+
+	if (split_entry_points)
+	{
+		const size_t module_size = (print_glsl || print_hlsl) ? module.hlsl.size() : module.spirv.size() * sizeof(uint32_t);
+
+		for (const reshadefx::entry_point &entry_point : module.entry_points)
+		{
+			const size_t entry_point_size = (print_glsl || print_hlsl) ? entry_point.hlsl.size() : entry_point.spirv.size() * sizeof(uint32_t);
+
+			std::cerr << entry_point.name << ": " << entry_point_size << " of " << module_size << " bytes (" << (module_size != 0 ? entry_point_size * 100 / module_size : 0) << "%)" << std::endl;
+		}
+	}
+
+	if (print_statistics)
+	{
+		std::cerr << "Eliminated " << backend->eliminated_texture_fetches() << " texture fetches, " << backend->eliminated_uniform_loads() << " uniform loads and " << backend->eliminated_operations() << " other operations" << std::endl;
+
+		if (!print_glsl && !print_hlsl)
+		{
+			// Count instructions in the SPIR-V module (the high half of the first word of every instruction is its word count), to compare the output of different compiler settings
+			size_t num_instructions = 0;
+			for (size_t offset = 5; offset < module.spirv.size() && (module.spirv[offset] >> 16) != 0; offset += module.spirv[offset] >> 16)
+				num_instructions++;
+
+			std::cerr << "Generated " << num_instructions << " SPIR-V instructions" << std::endl;
+		}
+	}
 
 	if (print_glsl || print_hlsl)
 	{